@@ -0,0 +1,53 @@
+/**
+ * @file api_example.c
+ *
+ * Example C client of the crcSentences library (see crc_sentences.h), searches a range of i and prints each
+ * hit and near miss as it is found.
+ *
+ *     apiExample [start] [length] [crc]
+ */
+#include "crc_sentences.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char * argv[])
+{
+    crcs_search_options options;
+    crcs_search_options_init(&options);
+    if(argc > 1) {
+        options.start = (uint32_t) strtoul(argv[1], NULL, 0);
+    }
+    options.length = argc > 2 ? strtoull(argv[2], NULL, 0) : 1 << 20;
+    if(argc > 3) {
+        options.crc = argv[3];
+    }
+
+    crcs_engine * engine = crcs_engine_create(0);
+    crcs_search * search = engine ? crcs_search_submit(engine, &options) : NULL;
+    if(!search) {
+        fprintf(stderr, "%s\n", crcs_last_error());
+        crcs_engine_destroy(engine);
+        return 1;
+    }
+
+    crcs_result results[64];
+    char sentence[256];
+    long n;
+    while((n = crcs_search_poll(search, results, 64, 1000)) >= 0) {
+        for(long k=0; k<n; k++) {
+            crcs_sentence(&results[k], sentence, sizeof(sentence));
+            printf("%s %08x %s\n", results[k].hit ? "HIT" : "NEAR MISS", results[k].hash, sentence);
+        }
+    }
+
+    crcs_search_stats stats;
+    stats.struct_size = sizeof(stats);
+    crcs_search_stats_get(search, &stats);
+    printf("%llu candidates, %llu hits, %llu near misses.\n", (unsigned long long) stats.candidates,
+           (unsigned long long) stats.hits, (unsigned long long) stats.near_misses);
+
+    crcs_search_release(search);
+    crcs_engine_destroy(engine);
+    return 0;
+}
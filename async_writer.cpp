@@ -0,0 +1,392 @@
+/**
+ * @file async_writer.cpp
+ *
+ * io_uring / pwrite file output, see async_writer.h
+ *
+ * io_uring is used through its system calls directly (as liburing would), so there is nothing extra to install.
+ */
+#include "async_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Buffers are aligned to this, the page size on anything we run on.
+static const size_t bufferAlignment = 4096;
+
+AsyncFileWriter::AsyncFileWriter(const std::string & path, size_t bufferSize, int numBuffers)
+        : bufferSize(bufferSize)
+{
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        std::cerr << "Could not create " << path << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    for(int i=0; i<numBuffers; i++)
+    {
+        void * data = nullptr;
+        if(posix_memalign(&data, bufferAlignment, bufferSize) != 0) {
+            break;
+        }
+        buffers.push_back(Buffer{(char *) data, 0, 0, 0});
+        freeBuffers.push_back(i);
+    }
+
+    // io_uring if we can, otherwise a thread doing pwrite.
+    if(!setupRing((unsigned) buffers.size() * 2)) {
+        thread = std::thread(&AsyncFileWriter::writerThread, this);
+    }
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    close();
+    for(Buffer & buffer : buffers) {
+        free(buffer.data);
+    }
+
+#ifdef HAVE_IO_URING
+    if(ringFd >= 0) {
+        munmap(sqes, sqesSize);
+        if(cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        munmap(sqRing, sqRingSize);
+        ::close(ringFd);
+    }
+#endif
+}
+
+void AsyncFileWriter::write(const char * data, size_t size)
+{
+    while(size > 0 && isOpen())
+    {
+        if(current < 0) {
+            current = acquire();
+        }
+
+        Buffer & buffer = buffers[current];
+        size_t n = std::min(size, bufferSize - buffer.used);
+        std::memcpy(buffer.data + buffer.used, data, n);
+        buffer.used += n;
+        data += n;
+        size -= n;
+
+        if(buffer.used == bufferSize) {
+            submit(current);
+            current = -1;
+        }
+    }
+}
+
+void AsyncFileWriter::flush()
+{
+    if(current >= 0 && buffers[current].used > 0) {
+        submit(current);
+        current = -1;
+    }
+}
+
+bool AsyncFileWriter::close()
+{
+    if(!isOpen()) {
+        return false;
+    }
+
+    flush();
+    waitAll();
+
+    if(thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+
+    ::close(fd);
+    fd = -1;
+    return !failed;
+}
+
+/**
+ * Gets an empty buffer, waiting for a write to complete if they are all in use.
+ */
+int AsyncFileWriter::acquire()
+{
+    if(usingIoUring()) {
+        reapRing(false);
+        while(freeBuffers.empty()) {
+            reapRing(true);
+        }
+    }
+    else {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]{ return !freeBuffers.empty(); });
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    int buffer = freeBuffers.back();
+    freeBuffers.pop_back();
+    return buffer;
+}
+
+/**
+ * Starts writing a buffer at the end of the file.
+ */
+void AsyncFileWriter::submit(int buffer)
+{
+    Buffer & b = buffers[buffer];
+    b.fileOffset = fileOffset;
+    b.written = 0;
+    fileOffset += b.used;
+
+    std::lock_guard<std::mutex> guard(lock);
+    inFlight++;
+    if(usingIoUring()) {
+        submitRing(buffer, 0);
+    }
+    else {
+        pending.push_back(buffer);
+        changed.notify_all();
+    }
+}
+
+/**
+ * Returns a written buffer to the free list, must be called holding the lock.
+ */
+void AsyncFileWriter::release(int buffer)
+{
+    buffers[buffer].used = 0;
+    freeBuffers.push_back(buffer);
+    inFlight--;
+    changed.notify_all();
+}
+
+void AsyncFileWriter::waitAll()
+{
+    if(usingIoUring()) {
+        while(inFlight > 0) {
+            reapRing(true);
+        }
+    }
+    else {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]{ return inFlight == 0; });
+    }
+}
+
+/**
+ * Writes a buffer with pwrite, handling short writes.
+ * @return false if the write failed.
+ */
+static bool writeFully(int fd, const char * data, size_t size, uint64_t offset)
+{
+    while(size > 0)
+    {
+        ssize_t n = pwrite(fd, data, size, (off_t) offset);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= (size_t) n;
+        offset += (uint64_t) n;
+    }
+    return true;
+}
+
+void AsyncFileWriter::writerThread()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while(true)
+    {
+        changed.wait(guard, [&]{ return stopping || !pending.empty(); });
+        if(pending.empty()) {
+            return;
+        }
+
+        int buffer = pending.front();
+        pending.pop_front();
+        Buffer & b = buffers[buffer];
+
+        guard.unlock();
+        bool ok = writeFully(fd, b.data, b.used, b.fileOffset);
+        guard.lock();
+
+        failed |= !ok;
+        release(buffer);
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+/**
+ * Asks the kernel whether the ring supports an opcode. Kernels before 5.6 have io_uring but neither
+ * IORING_OP_WRITE nor the probe, so a failed probe counts as not supported.
+ */
+static bool opcodeSupported(int ringFd, int opcode)
+{
+#ifdef IO_URING_OP_SUPPORTED
+    const unsigned numOps = 256;
+    std::vector<char> probeData(sizeof(io_uring_probe) + numOps * sizeof(io_uring_probe_op), 0);
+    io_uring_probe * probe = (io_uring_probe *) probeData.data();
+    if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, numOps) < 0) {
+        return false;
+    }
+    return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Creates the ring and maps its submission queue, completion queue and submission entries.
+ * @return false if io_uring is not available, or can not write to files.
+ */
+bool AsyncFileWriter::setupRing(unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringFd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd < 0) {
+        return false;
+    }
+    if(!opcodeSupported(ringFd, IORING_OP_WRITE)) {
+        ::close(ringFd);
+        ringFd = -1;
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = singleMap ? sqRing
+                       : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+    if(sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        if(sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if(cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        ::close(ringFd);
+        ringFd = -1;
+        return false;
+    }
+
+    char * sq = (char *) sqRing;
+    sqHead = (unsigned *)(sq + params.sq_off.head);
+    sqTail = (unsigned *)(sq + params.sq_off.tail);
+    sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned *)(sq + params.sq_off.array);
+
+    char * cq = (char *) cqRing;
+    cqHead = (unsigned *)(cq + params.cq_off.head);
+    cqTail = (unsigned *)(cq + params.cq_off.tail);
+    cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+    return true;
+}
+
+/**
+ * Queues a write of a buffer (from skip bytes in) and tells the kernel about it.
+ * The ring has room for twice the buffers, so there is always a free entry.
+ */
+void AsyncFileWriter::submitRing(int buffer, size_t skip)
+{
+    Buffer & b = buffers[buffer];
+
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe * sqe = &((io_uring_sqe *) sqes)[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)(b.data + skip);
+    sqe->len = (uint32_t)(b.used - skip);
+    sqe->off = b.fileOffset + skip;
+    sqe->user_data = (uint64_t) buffer;
+
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    if(syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) < 0) {
+        // could not submit, take the entry back and write it here instead.
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        failed |= !writeFully(fd, b.data + skip, b.used - skip, b.fileOffset + skip);
+        release(buffer);
+    }
+}
+
+/**
+ * Handles completed writes, resubmitting the rest of any short write.
+ * @param wait True to block until at least one write completes.
+ */
+void AsyncFileWriter::reapRing(bool wait)
+{
+    if(wait) {
+        syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    unsigned head = *cqHead;
+    while(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+        io_uring_cqe * cqe = &((io_uring_cqe *) cqes)[head & *cqMask];
+        int buffer = (int) cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        Buffer & b = buffers[buffer];
+        if(res == -EINTR || res == -EAGAIN) {
+            submitRing(buffer, b.written);
+        }
+        else if(res < 0) {
+            // the kernel could not do the write (eg: an opcode it lacks), try the rest of it with pwrite.
+            failed |= !writeFully(fd, b.data + b.written, b.used - b.written, b.fileOffset + b.written);
+            release(buffer);
+        }
+        else if((b.written += (size_t) res) < b.used && res > 0) {
+            submitRing(buffer, b.written);
+        }
+        else {
+            failed |= b.written < b.used;
+            release(buffer);
+        }
+    }
+}
+
+#else
+
+bool AsyncFileWriter::setupRing(unsigned)
+{
+    return false;
+}
+
+void AsyncFileWriter::submitRing(int, size_t) { }
+
+void AsyncFileWriter::reapRing(bool) { }
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file async_writer.h
+ *
+ * Asynchronous file output for results. Text is gathered into large, page aligned buffers, full buffers
+ * are handed to the kernel with io_uring and the caller carries on filling the next buffer. Where io_uring
+ * is not available (old kernel, seccomp, not built with it) a background thread writes the buffers with pwrite,
+ * as is any write the ring fails.
+ * Either way the caller only waits when every buffer is in flight, eg: on a very slow network volume.
+ */
+#ifndef CRC_SENTENCES_ASYNC_WRITER_H
+#define CRC_SENTENCES_ASYNC_WRITER_H
+
+#include "pipeline.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AsyncFileWriter : public TextOutput
+{
+public:
+    /**
+     * Creates (truncates) the file at path.
+     * @param bufferSize Size of each buffer, a multiple of the page size.
+     * @param numBuffers Number of buffers, ie: writes that can be in flight at once (+1 being filled).
+     */
+    AsyncFileWriter(const std::string & path, size_t bufferSize = 1 << 20, int numBuffers = 8);
+    ~AsyncFileWriter();
+
+    bool isOpen() const { return fd >= 0; }
+    bool usingIoUring() const { return ringFd >= 0; }
+
+    void write(const char * data, size_t size) override;
+
+    /**
+     * Starts writing whatever is buffered, without waiting for it.
+     */
+    void flush() override;
+
+    /**
+     * Writes everything, waits for it to complete and closes the file.
+     * @return false if any write failed.
+     */
+    bool close();
+
+private:
+    struct Buffer
+    {
+        char * data;
+        size_t used;         // bytes of data filled
+        size_t written;      // bytes of data written so far, once submitted
+        uint64_t fileOffset;
+    };
+
+    int acquire();
+    void submit(int buffer);
+    void release(int buffer);
+    void waitAll();
+
+    // io_uring
+    bool setupRing(unsigned entries);
+    void submitRing(int buffer, size_t skip);
+    void reapRing(bool wait);
+
+    // pwrite fallback
+    void writerThread();
+
+    int fd = -1;
+    size_t bufferSize;
+    std::vector<Buffer> buffers;
+    int current = -1;            // buffer being filled
+    uint64_t fileOffset = 0;     // where the next submitted buffer goes
+    bool failed = false;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<int> freeBuffers;
+    int inFlight = 0;
+
+    // io_uring state, see setupRing
+    int ringFd = -1;
+    void * sqRing = nullptr;
+    void * cqRing = nullptr;
+    void * sqes = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    unsigned * sqHead = nullptr;
+    unsigned * sqTail = nullptr;
+    unsigned * sqMask = nullptr;
+    unsigned * sqArray = nullptr;
+    unsigned * cqHead = nullptr;
+    unsigned * cqTail = nullptr;
+    unsigned * cqMask = nullptr;
+    void * cqes = nullptr;
+
+    // pwrite fallback state
+    std::deque<int> pending;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif //CRC_SENTENCES_ASYNC_WRITER_H
@@ -0,0 +1,133 @@
+/**
+ * @file benchmark.cpp
+ *
+ * Scaling benchmark, see benchmark.h
+ */
+#include "benchmark.h"
+#include "concurrency.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+enum class Placement {Unpinned, OnePerCore, PackSiblings};
+
+static const char * placementName(Placement placement)
+{
+    switch(placement) {
+        case Placement::Unpinned: return "unpinned";
+        case Placement::OnePerCore: return "pinned";
+        default: return "pinned-smt";
+    }
+}
+
+/**
+ * What one search thread did in a run.
+ */
+struct ThreadTally
+{
+    uint64_t candidates = 0;
+    double seconds = 0;
+};
+
+/**
+ * Searches the whole range once with the given threads.
+ * @return Wall clock seconds.
+ */
+static double timeRun(uint32_t start, uint32_t length, uint32_t chunkSize, const std::vector<int> & cpus,
+                      const ChunkSearch & search, std::vector<ThreadTally> & tallies)
+{
+    FamilyScheduler scheduler(start, length, chunkSize);
+    std::vector<std::thread> threads;
+    auto startTime = std::chrono::steady_clock::now();
+
+    for(size_t t=0; t<tallies.size(); t++)
+    {
+        threads.emplace_back([&, t]
+        {
+            if(!cpus.empty()) {
+                pinThread(cpus[t % cpus.size()]);
+            }
+            WorkChunk chunk;
+            while(scheduler.next(chunk)) {
+                ChunkResult result = search(chunk);
+                scheduler.complete(chunk, result);
+                tallies[t].candidates += result.candidates;
+            }
+            tallies[t].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        });
+    }
+    for(std::thread & thread : threads) {
+        thread.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void runScalingBenchmark(uint32_t start, uint32_t length, const std::vector<uint32_t> & chunkSizes, int maxThreads,
+                         const ChunkSearch & search, std::ostream & csv, std::ostream & log)
+{
+    std::vector<int> threadCounts;
+    for(int n=1; n<maxThreads; n*=2) {
+        threadCounts.push_back(n);
+    }
+    threadCounts.push_back(std::max(maxThreads - 1, 1));
+    threadCounts.push_back(maxThreads);
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    // packing siblings is the same as one per core without SMT.
+    std::vector<Placement> placements = {Placement::Unpinned, Placement::OnePerCore};
+    if(hasSmtSiblings()) {
+        placements.push_back(Placement::PackSiblings);
+    }
+
+    csv.imbue(std::locale::classic());
+    csv << "threads,chunk_size,placement,seconds,candidates,candidates_per_sec,speedup,efficiency,"
+           "min_thread_rate,max_thread_rate,thread_rates" << std::endl;
+
+    for(uint32_t chunkSize : chunkSizes)
+    {
+        for(Placement placement : placements)
+        {
+            std::vector<int> cpus;
+            if(placement != Placement::Unpinned) {
+                cpus = cpuPlacement(placement == Placement::PackSiblings);
+            }
+
+            double baseRate = 0;
+            for(int threads : threadCounts)
+            {
+                std::vector<ThreadTally> tallies(threads);
+                double seconds = timeRun(start, length, chunkSize, cpus, search, tallies);
+
+                uint64_t candidates = 0;
+                std::vector<double> rates;
+                std::ostringstream rateList;
+                rateList.imbue(std::locale::classic());
+                for(const ThreadTally & tally : tallies) {
+                    candidates += tally.candidates;
+                    rates.push_back(tally.seconds > 0 ? tally.candidates / tally.seconds : 0);
+                    rateList << (rates.size() > 1 ? ";" : "") << (uint64_t) rates.back();
+                }
+
+                double rate = candidates / seconds;
+                if(threads == 1) {
+                    baseRate = rate;
+                }
+                double speedup = baseRate > 0 ? rate / baseRate : 0;
+
+                csv << threads << "," << chunkSize << "," << placementName(placement) << ","
+                    << std::fixed << std::setprecision(3) << seconds << "," << candidates << ","
+                    << std::setprecision(0) << rate << "," << std::setprecision(3) << speedup << ","
+                    << speedup / threads << "," << std::setprecision(0)
+                    << *std::min_element(rates.begin(), rates.end()) << ","
+                    << *std::max_element(rates.begin(), rates.end()) << "," << rateList.str() << std::endl;
+
+                log << threads << " threads, chunk size " << chunkSize << ", " << placementName(placement)
+                    << ": " << (uint64_t) rate << " candidates/s" << std::endl;
+            }
+        }
+    }
+}
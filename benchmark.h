@@ -0,0 +1,33 @@
+/**
+ * @file benchmark.h
+ *
+ * Scaling benchmark: searches a fixed i range at a range of thread counts, chunk sizes and thread placements
+ * (unpinned, pinned one per core, pinned packing SMT siblings), and reports the throughput of each as CSV.
+ * main() leaves a cpu spare, this gives the data to decide whether that pays off on a given host.
+ *
+ * Thread counts tried are the powers of two below the number of usable cpus, plus that number and one less.
+ * Speedup is relative to a single thread with the same chunk size and placement.
+ */
+#ifndef CRC_SENTENCES_BENCHMARK_H
+#define CRC_SENTENCES_BENCHMARK_H
+
+#include "scheduler.h"
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+/**
+ * Searches a chunk, as a search thread would (without output).
+ */
+typedef std::function<ChunkResult(const WorkChunk &)> ChunkSearch;
+
+/**
+ * Runs every combination and writes a CSV row for each, progress goes to log.
+ * @param maxThreads Usable cpus, the most threads tried.
+ */
+void runScalingBenchmark(uint32_t start, uint32_t length, const std::vector<uint32_t> & chunkSizes, int maxThreads,
+                         const ChunkSearch & search, std::ostream & csv, std::ostream & log);
+
+#endif //CRC_SENTENCES_BENCHMARK_H
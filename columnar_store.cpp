@@ -0,0 +1,332 @@
+/**
+ * @file columnar_store.cpp
+ *
+ * Columnar result store, see columnar_store.h
+ */
+#include "columnar_store.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// bits of a result's nibble in the flags column.
+static const uint8_t storeUpperCase = 1;
+static const uint8_t storeHit = 2;
+static const uint8_t storeCaseFlipped = 4;
+
+static void putVarint(std::string & out, uint64_t value)
+{
+    while(value >= 0x80) {
+        out += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += (char) value;
+}
+
+/**
+ * @return false if the data ran out part way through a value.
+ */
+static bool getVarint(const uint8_t *& in, const uint8_t * end, uint64_t & value)
+{
+    value = 0;
+    for(int shift=0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// zigzag encoding, so small negative distances are small varints.
+static uint64_t zigzag(long value) { return ((uint64_t) value << 1) ^ (uint64_t)(value >> 63); }
+static long unzigzag(uint64_t value) { return (long)(value >> 1) ^ -(long)(value & 1); }
+
+static long distance(const SearchResult & result)
+{
+    return (long) result.crc - (long) result.i;
+}
+
+ColumnarStoreWriter::ColumnarStoreWriter(const std::string & path, size_t blockSize)
+        : out(path), blockSize(blockSize)
+{
+    StoreFileHeader header = {storeMagic, storeVersion};
+    out.write((const char *) &header, sizeof(header));
+}
+
+ColumnarStoreWriter::~ColumnarStoreWriter()
+{
+    close();
+}
+
+void ColumnarStoreWriter::emit(ResultBatch && batch)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for(const SearchResult & result : batch) {
+        pending.push_back(result);
+        if(pending.size() >= blockSize) {
+            writeBlock();
+        }
+    }
+}
+
+bool ColumnarStoreWriter::close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(!out.isOpen()) {
+        return false;
+    }
+    writeBlock();
+    return out.close();
+}
+
+/**
+ * Encodes the pending results as a block, must be called holding the lock.
+ */
+void ColumnarStoreWriter::writeBlock()
+{
+    if(pending.empty()) {
+        return;
+    }
+
+    // sorted by i, so the i column is small deltas.
+    std::sort(pending.begin(), pending.end(), resultOrder);
+
+    StoreBlockHeader header = {};
+    header.count = (uint32_t) pending.size();
+    header.iMin = pending.front().i;
+    header.iMax = pending.back().i;
+    header.distMin = header.distMax = (int32_t) distance(pending.front());
+    header.opMin = header.opMax = pending.front().operation;
+
+    // i column, the first value then the increase from the previous.
+    encoded.clear();
+    uint32_t previous = 0;
+    for(const SearchResult & result : pending) {
+        putVarint(encoded, result.i - previous);
+        previous = result.i;
+    }
+    header.iBytes = (uint32_t) encoded.size();
+
+    // opcode column, a byte each (two if any opcode needs it, opBytes / count gives the width)
+    for(const SearchResult & result : pending) {
+        header.opMin = std::min(header.opMin, result.operation);
+        header.opMax = std::max(header.opMax, result.operation);
+    }
+    for(const SearchResult & result : pending) {
+        encoded += (char)(result.operation & 0xff);
+        if(header.opMax > 0xff) {
+            encoded += (char)(result.operation >> 8);
+        }
+    }
+    header.opBytes = (uint32_t) encoded.size() - header.iBytes;
+
+    // flags column, a nibble per result, and case flips column, a byte per result with any.
+    std::string flags((pending.size() + 1) / 2, '\0');
+    std::string flips;
+    for(size_t k=0; k<pending.size(); k++) {
+        const SearchResult & result = pending[k];
+        uint8_t flag = (result.upperCase ? storeUpperCase : 0) | (result.hit ? storeHit : 0) |
+                       (result.caseFlips ? storeCaseFlipped : 0);
+        flags[k / 2] |= (char)(flag << (4 * (k % 2)));
+        if(result.caseFlips) {
+            flips += (char) result.caseFlips;
+        }
+    }
+    encoded += flags;
+    encoded += flips;
+    header.flagBytes = (uint32_t) flags.size();
+    header.flipBytes = (uint32_t) flips.size();
+
+    // distance column, signed.
+    size_t distStart = encoded.size();
+    for(const SearchResult & result : pending) {
+        long dist = distance(result);
+        putVarint(encoded, zigzag(dist));
+        header.distMin = std::min(header.distMin, (int32_t) dist);
+        header.distMax = std::max(header.distMax, (int32_t) dist);
+    }
+    header.distBytes = (uint32_t)(encoded.size() - distStart);
+
+    out.write((const char *) &header, sizeof(header));
+    out.write(encoded.data(), encoded.size());
+    pending.clear();
+}
+
+/**
+ * Opens a store and checks its file header.
+ */
+static bool openStore(std::ifstream & in, const std::string & path)
+{
+    in.open(path, std::ios::binary);
+    StoreFileHeader header;
+    if(!in.read((char *) &header, sizeof(header))) {
+        return false;
+    }
+    return header.magic == storeMagic && header.version == storeVersion;
+}
+
+bool scanStoreDistances(const std::string & path, StoreStats & stats)
+{
+    std::ifstream in;
+    if(!openStore(in, path)) {
+        return false;
+    }
+    stats.bytesRead += sizeof(StoreFileHeader);
+
+    StoreBlockHeader header;
+    std::vector<uint8_t> flags, column;
+    while(in.read((char *) &header, sizeof(header)))
+    {
+        // jump over the other columns
+        in.seekg(header.iBytes + header.opBytes, std::ios::cur);
+        flags.resize(header.flagBytes);
+        if(header.flagBytes != (header.count + 1) / 2 || !in.read((char *) flags.data(), flags.size())) {
+            return false;
+        }
+        in.seekg(header.flipBytes, std::ios::cur);
+        column.resize(header.distBytes);
+        if(!in.read((char *) column.data(), column.size())) {
+            return false;
+        }
+        stats.blocks++;
+        stats.bytesRead += sizeof(header) + flags.size() + column.size();
+
+        for(uint32_t k=0; k<header.count; k++) {
+            if((flags[k / 2] >> (4 * (k % 2))) & storeHit) {
+                stats.hits++;
+            }
+        }
+
+        const uint8_t * p = column.data();
+        const uint8_t * end = p + column.size();
+        for(uint32_t k=0; k<header.count; k++) {
+            uint64_t value;
+            if(!getVarint(p, end, value)) {
+                return false;
+            }
+            stats.distances[unzigzag(value)]++;
+            stats.results++;
+        }
+    }
+    return in.eof();
+}
+
+bool readStore(const std::string & path, uint32_t iMin, uint32_t iMax,
+               const std::function<void(const SearchResult &)> & callback)
+{
+    std::ifstream in;
+    if(!openStore(in, path)) {
+        return false;
+    }
+
+    StoreBlockHeader header;
+    std::vector<uint8_t> block;
+    while(in.read((char *) &header, sizeof(header)))
+    {
+        size_t blockBytes = (size_t) header.iBytes + header.opBytes + header.flagBytes + header.flipBytes +
+                            header.distBytes;
+
+        // block index, skip blocks out of range without reading them
+        if(header.iMax < iMin || header.iMin > iMax) {
+            in.seekg(blockBytes, std::ios::cur);
+            continue;
+        }
+
+        block.resize(blockBytes);
+        if(!in.read((char *) block.data(), block.size())) {
+            return false;
+        }
+
+        const uint8_t * iCol = block.data();
+        const uint8_t * opCol = iCol + header.iBytes;
+        const uint8_t * flagCol = opCol + header.opBytes;
+        const uint8_t * flipCol = flagCol + header.flagBytes;
+        const uint8_t * distCol = flipCol + header.flipBytes;
+        const uint8_t * end = distCol + header.distBytes;
+
+        uint32_t opWidth = header.count ? header.opBytes / header.count : 1;
+        if(opWidth < 1 || opWidth > 2 || header.opBytes != opWidth * header.count ||
+           header.flagBytes != (header.count + 1) / 2) {
+            return false;
+        }
+        const uint8_t * flipEnd = distCol;
+
+        uint32_t i = 0;
+        for(uint32_t k=0; k<header.count; k++)
+        {
+            uint64_t delta, dist;
+            if(!getVarint(iCol, opCol, delta) || !getVarint(distCol, end, dist)) {
+                return false;
+            }
+            i += (uint32_t) delta;
+
+            uint16_t operation = opCol[k * opWidth];
+            if(opWidth == 2) {
+                operation |= (uint16_t)(opCol[k * 2 + 1] << 8);
+            }
+
+            SearchResult result;
+            result.i = i;
+            result.crc = (uint32_t)((long) i + unzigzag(dist));
+            result.operation = operation;
+            uint8_t flag = (flagCol[k / 2] >> (4 * (k % 2))) & 0xf;
+            result.upperCase = (flag & storeUpperCase) != 0;
+            result.hit = (flag & storeHit) != 0;
+            if(flag & storeCaseFlipped) {
+                if(flipCol == flipEnd) {
+                    return false;
+                }
+                result.caseFlips = *flipCol++;
+            }
+            if(i >= iMin && i <= iMax) {
+                callback(result);
+            }
+        }
+    }
+    return in.eof();
+}
+
+int printStoreStats(const std::string & path)
+{
+    StoreStats stats;
+    if(!scanStoreDistances(path, stats)) {
+        std::cerr << "Could not read store " << path << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    long long fileSize = (long long) file.tellg();
+
+    std::cout << path << ": " << stats.results << " results in " << stats.blocks << " blocks, "
+              << fileSize << " bytes (" << std::fixed << std::setprecision(2)
+              << (stats.results ? (double) fileSize / stats.results : 0.0) << " per result), "
+              << stats.bytesRead << " bytes scanned." << std::endl;
+
+    std::cout << stats.hits << " hits." << std::endl;
+
+    std::cout << "distance  count" << std::endl;
+    for(const auto & d : stats.distances) {
+        std::cout << std::setw(8) << d.first << "  " << d.second << std::endl;
+    }
+
+    // hits are rare, so only then is every column read, to regenerate their sentences.
+    if(stats.hits > 0)
+    {
+        std::string text;
+        bool read = readStore(path, 0, 0xffffffff, [&](const SearchResult & result) {
+            if(result.hit) {
+                appendResult(text, result);
+            }
+        });
+        std::cout << text;
+        if(!read) {
+            std::cerr << "Could not read the hits of store " << path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file columnar_store.h
+ *
+ * Compact storage of hits and near misses. Rather than a line of text per result, results are stored in
+ * blocks of columns (i, opcode, flags, case flips, signed distance). i is delta / varint encoded, the opcode is
+ * a byte, the flags (upper case, hit, has case flips) a nibble, the case flips a byte for only those results
+ * that have them, and distance a zigzag varint (a byte for any near miss).
+ * The sentence can be regenerated from the opcode, case, case flips and i, so it is not stored.
+ *
+ * File layout:
+ *     StoreFileHeader
+ *     blocks of: StoreBlockHeader, i column, opcode column, flags column, case flips column, distance column
+ *
+ * Each block header has the min/max of its columns and the byte length of each column, so readers can
+ * skip blocks, or scan a single column (eg: distance, for yield statistics) without decoding the rest.
+ */
+#ifndef CRC_SENTENCES_COLUMNAR_STORE_H
+#define CRC_SENTENCES_COLUMNAR_STORE_H
+
+#include "async_writer.h"
+#include "pipeline.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+// "CRCN" and the format version.
+const uint32_t storeMagic = 0x4e435243;
+const uint32_t storeVersion = 2;
+
+struct StoreFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct StoreBlockHeader
+{
+    uint32_t count;       // results in the block
+    uint32_t iMin;        // block index, the range of each column
+    uint32_t iMax;
+    int32_t distMin;
+    int32_t distMax;
+    uint16_t opMin;
+    uint16_t opMax;
+    uint32_t iBytes;      // encoded size of each column, in the order they follow the header
+    uint32_t opBytes;
+    uint32_t flagBytes;
+    uint32_t flipBytes;
+    uint32_t distBytes;
+};
+
+/**
+ * Result sink that writes a store. Safe to share between search threads.
+ */
+class ColumnarStoreWriter : public ResultSink
+{
+public:
+    /**
+     * @param blockSize Results per block, larger blocks compress slightly better.
+     */
+    ColumnarStoreWriter(const std::string & path, size_t blockSize = 4096);
+    ~ColumnarStoreWriter();
+
+    bool isOpen() const { return out.isOpen(); }
+
+    void emit(ResultBatch && batch) override;
+
+    /**
+     * Writes the last (partial) block and closes the file.
+     * @return false if the file could not be written.
+     */
+    bool close();
+
+private:
+    void writeBlock();
+
+    std::mutex lock;
+    AsyncFileWriter out;
+    size_t blockSize;
+    ResultBatch pending;
+    std::string encoded;
+};
+
+/**
+ * What a scan of the flags and distance columns found.
+ */
+struct StoreStats
+{
+    uint64_t results = 0;
+    uint64_t hits = 0;                // results flagged as hits, which with fewer than 32 match bits need not be 0 away
+    uint64_t blocks = 0;
+    uint64_t bytesRead = 0;           // of the file, headers, flags and distance columns
+    std::map<long, uint64_t> distances;  // count of results at each distance
+};
+
+/**
+ * Gathers yield statistics by reading only the block headers, flags and distance columns.
+ * @return false if the file could not be read.
+ */
+bool scanStoreDistances(const std::string & path, StoreStats & stats);
+
+/**
+ * Decodes every result in the store, skipping blocks whose i range is outside [iMin, iMax].
+ * @return false if the file could not be read.
+ */
+bool readStore(const std::string & path, uint32_t iMin, uint32_t iMax,
+               const std::function<void(const SearchResult &)> & callback);
+
+/**
+ * Prints the statistics of a store, and the sentence of every hit in it, used by --store-stats.
+ * @return The process exit code.
+ */
+int printStoreStats(const std::string & path);
+
+#endif //CRC_SENTENCES_COLUMNAR_STORE_H
@@ -0,0 +1,363 @@
+/**
+ * @file concurrency.cpp
+ *
+ * Detection of usable cpus and throttling, see concurrency.h
+ */
+#include "concurrency.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// How often cpu.stat is read.
+static const std::chrono::seconds throttleSampleInterval(5);
+
+// Fraction of the sample interval spent throttled before a worker is parked.
+static const double throttleTolerance = 0.02;
+
+// Number of unthrottled samples in a row before a parked worker is brought back.
+static const int samplesBeforeGrowing = 6;
+
+int CpuLimits::usableThreads() const
+{
+    int threads = hardwareThreads;
+    if(affinityThreads > 0) {
+        threads = threads > 0 ? std::min(threads, affinityThreads) : affinityThreads;
+    }
+    if(cpuQuota > 0) {
+        // a quota of 1.5 cpus can keep 2 threads busy half the time, round up.
+        int quotaThreads = std::max((int) std::ceil(cpuQuota), 1);
+        threads = threads > 0 ? std::min(threads, quotaThreads) : quotaThreads;
+    }
+    return std::max(threads, 1);
+}
+
+/**
+ * Finds the cgroup v2 directory of this process, from the cgroup2 mount point and /proc/self/cgroup.
+ * @param mountPoint Set to where the cgroup2 file system is mounted.
+ * @return The directory, or "" if cgroup v2 is not in use.
+ */
+static std::string findCgroupDir(std::string & mountPoint)
+{
+    // mount point of the cgroup2 file system (field 5 of mountinfo, the file system type follows " - ").
+    std::ifstream mountInfo("/proc/self/mountinfo");
+    std::string line;
+    while(std::getline(mountInfo, line))
+    {
+        size_t sep = line.find(" - ");
+        if(sep == std::string::npos || line.compare(sep + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string field;
+        for(int i=0; i<5 && (fields >> field); i++) {}
+        mountPoint = field;
+        break;
+    }
+    if(mountPoint.empty()) {
+        return "";
+    }
+
+    // the v2 hierarchy is the "0::<path>" line.
+    std::ifstream cgroups("/proc/self/cgroup");
+    while(std::getline(cgroups, line)) {
+        if(line.compare(0, 3, "0::") == 0) {
+            std::string path = line.substr(3);
+            return path == "/" ? mountPoint : mountPoint + path;
+        }
+    }
+    return "";
+}
+
+/**
+ * Reads cpu.max ("<quota> <period>", or "max <period>"), walking up the hierarchy as a parent can be the one limiting us.
+ * @return The quota in cpus, 0 if unlimited.
+ */
+static double readCpuQuota(std::string dir, const std::string & root)
+{
+    double quota = 0;
+    while(true)
+    {
+        std::ifstream cpuMax(dir + "/cpu.max");
+        std::string max;
+        double period = 0;
+        if(cpuMax >> max >> period && max != "max" && period > 0) {
+            double q = std::stod(max) / period;
+            quota = quota > 0 ? std::min(quota, q) : q;
+        }
+
+        if(dir.length() <= root.length()) {
+            break;
+        }
+        dir = dir.substr(0, dir.find_last_of('/'));
+    }
+    return quota;
+}
+
+CpuLimits detectCpuLimits()
+{
+    CpuLimits limits;
+    limits.hardwareThreads = (int) std::thread::hardware_concurrency();
+
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if(sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        limits.affinityThreads = CPU_COUNT(&cpus);
+    }
+
+    std::string mountPoint;
+    limits.cgroupDir = findCgroupDir(mountPoint);
+    if(!limits.cgroupDir.empty()) {
+        limits.cpuQuota = readCpuQuota(limits.cgroupDir, mountPoint);
+    }
+#endif
+
+    return limits;
+}
+
+void printCpuLimits(const CpuLimits & limits, std::ostream & out)
+{
+    out << "Detected ability to use " << limits.usableThreads() << " threads"
+        << " (host " << limits.hardwareThreads
+        << ", affinity " << limits.affinityThreads;
+    if(limits.cpuQuota > 0) {
+        out << ", cgroup quota " << limits.cpuQuota;
+    }
+    else {
+        out << ", no cgroup quota";
+    }
+    out << ")." << std::endl;
+}
+
+/**
+ * The cpus allowed to run this process, grouped by physical core (package and core id).
+ */
+static std::vector<std::vector<int>> coreSiblings()
+{
+    std::vector<std::pair<std::pair<int, int>, int>> cpus;  // ((package, core), cpu)
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for(int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+            if(!CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+
+            // unknown topology, treat the cpu as a core of its own.
+            std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            int package = -1, core = -1 - cpu;
+            std::ifstream(topology + "physical_package_id") >> package;
+            std::ifstream(topology + "core_id") >> core;
+            cpus.push_back({{package, core}, cpu});
+        }
+    }
+#endif
+
+    std::sort(cpus.begin(), cpus.end());
+    std::vector<std::vector<int>> cores;
+    for(size_t k=0; k<cpus.size(); k++) {
+        if(k == 0 || cpus[k].first != cpus[k-1].first) {
+            cores.emplace_back();
+        }
+        cores.back().push_back(cpus[k].second);
+    }
+    return cores;
+}
+
+std::vector<int> cpuPlacement(bool packSiblings)
+{
+    std::vector<std::vector<int>> cores = coreSiblings();
+    std::vector<int> order;
+    if(packSiblings) {
+        for(const std::vector<int> & siblings : cores) {
+            order.insert(order.end(), siblings.begin(), siblings.end());
+        }
+    }
+    else {
+        // the first cpu of every core, then the second of every core, ...
+        for(size_t round=0; ; round++) {
+            size_t added = 0;
+            for(const std::vector<int> & siblings : cores) {
+                if(round < siblings.size()) {
+                    order.push_back(siblings[round]);
+                    added++;
+                }
+            }
+            if(added == 0) {
+                break;
+            }
+        }
+    }
+    return order;
+}
+
+bool hasSmtSiblings()
+{
+    for(const std::vector<int> & siblings : coreSiblings()) {
+        if(siblings.size() > 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool pinThread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+}
+
+WorkerGate::WorkerGate(int activeWorkers) : active(activeWorkers), limit(std::numeric_limits<int>::max()) { }
+
+void WorkerGate::wait(int worker)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if(finished || worker < std::min(active, limit)) {
+        return;
+    }
+    TraceScope scope("parked", "throttle");
+    changed.wait(guard, [&]{ return finished || worker < std::min(active, limit); });
+}
+
+void WorkerGate::setActive(int activeWorkers)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        active = activeWorkers;
+    }
+    changed.notify_all();
+}
+
+void WorkerGate::setLimit(int maxActive)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        limit = maxActive;
+    }
+    changed.notify_all();
+}
+
+int WorkerGate::getActive() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return std::min(active, limit);
+}
+
+int WorkerGate::getLimit() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return limit;
+}
+
+int WorkerGate::getRequested() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return active;
+}
+
+void WorkerGate::finish()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished = true;
+    }
+    changed.notify_all();
+}
+
+ThrottleMonitor::ThrottleMonitor(const CpuLimits & limits, WorkerGate & gate, int maxWorkers)
+        : gate(gate), maxWorkers(maxWorkers)
+{
+    if(!limits.cgroupDir.empty()) {
+        cpuStatPath = limits.cgroupDir + "/cpu.stat";
+    }
+}
+
+ThrottleMonitor::~ThrottleMonitor()
+{
+    stop();
+}
+
+/**
+ * Reads throttled_usec from cpu.stat.
+ * @return The total time throttled, or -1 if it is not available (no cpu controller).
+ */
+static long long readThrottledTime(const std::string & cpuStatPath)
+{
+    std::ifstream cpuStat(cpuStatPath);
+    std::string key;
+    long long value;
+    while(cpuStat >> key >> value) {
+        if(key == "throttled_usec") {
+            return value;
+        }
+    }
+    return -1;
+}
+
+void ThrottleMonitor::start()
+{
+    if(cpuStatPath.empty() || readThrottledTime(cpuStatPath) < 0) {
+        return;
+    }
+    thread = std::thread(&ThrottleMonitor::run, this);
+}
+
+void ThrottleMonitor::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopRequested = true;
+    }
+    stopped.notify_all();
+    if(thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ThrottleMonitor::run()
+{
+    long long lastThrottled = readThrottledTime(cpuStatPath);
+    int calmSamples = 0;
+
+    std::unique_lock<std::mutex> guard(lock);
+    while(!stopped.wait_for(guard, throttleSampleInterval, [&]{ return stopRequested; }))
+    {
+        long long throttled = readThrottledTime(cpuStatPath);
+        double fraction = (double)(throttled - lastThrottled)
+                        / (double) std::chrono::duration_cast<std::chrono::microseconds>(throttleSampleInterval).count();
+        lastThrottled = throttled;
+
+        // only the monitor's own count is changed, an operator's limit (see control.h) applies on top of it,
+        // so raising the limit brings back workers the monitor did not park.
+        int active = gate.getRequested();
+        if(fraction > throttleTolerance) {
+            calmSamples = 0;
+            if(active > 1) {
+                gate.setActive(active - 1);
+                std::cout << "cpu throttled " << (int)(fraction * 100) << "% of the time, now using "
+                          << gate.getActive() << " threads." << std::endl;
+            }
+        }
+        else if(++calmSamples >= samplesBeforeGrowing && active < maxWorkers) {
+            calmSamples = 0;
+            gate.setActive(active + 1);
+            std::cout << "cpu no longer throttled, now using " << gate.getActive() << " threads." << std::endl;
+        }
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * @file concurrency.h
+ *
+ * Works out how many threads the search can really use, and parks threads if the cpu quota is being exceeded.
+ *
+ * std::thread::hardware_concurrency() reports the cores of the host, in a container the cpu quota (cgroup v2
+ * cpu.max) and the affinity mask can be much smaller. Running more threads than the quota allows gets the whole
+ * process throttled, so the number of active workers is also adjusted at runtime based on cgroup cpu.stat.
+ */
+#ifndef CRC_SENTENCES_CONCURRENCY_H
+#define CRC_SENTENCES_CONCURRENCY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * What was found out about the cpus available to this process, 0 means "could not tell".
+ */
+struct CpuLimits
+{
+    int hardwareThreads = 0;  // std::thread::hardware_concurrency()
+    int affinityThreads = 0;  // cpus in the affinity mask
+    double cpuQuota = 0;      // cgroup v2 cpu.max (quota / period), 0 if unlimited
+    std::string cgroupDir;    // cgroup v2 directory of this process, empty if not found
+
+    /**
+     * @return The number of threads that can run at once, at least 1.
+     */
+    int usableThreads() const;
+};
+
+/**
+ * Reads the limits on cpu usage of this process.
+ */
+CpuLimits detectCpuLimits();
+
+void printCpuLimits(const CpuLimits & limits, std::ostream & out);
+
+/**
+ * The cpus in the affinity mask, in the order threads should be pinned to them.
+ * @param packSiblings true to fill every SMT sibling of a core before the next core,
+ *                     false to use one cpu of each core before any siblings.
+ */
+std::vector<int> cpuPlacement(bool packSiblings);
+
+/**
+ * @return true if the cpus have SMT siblings (more than one cpu per core).
+ */
+bool hasSmtSiblings();
+
+/**
+ * Pins the calling thread to a cpu.
+ * @return false if that is not possible.
+ */
+bool pinThread(int cpu);
+
+/**
+ * Lets a number of workers run, the rest wait (parked) until they are needed.
+ * Workers are numbered 0 to maxWorkers-1, the lowest numbered workers are the active ones.
+ */
+class WorkerGate
+{
+public:
+    explicit WorkerGate(int activeWorkers);
+
+    /**
+     * Blocks while this worker is parked.
+     */
+    void wait(int worker);
+
+    /**
+     * Changes the number of active workers, parked workers are woken if they become active.
+     */
+    void setActive(int activeWorkers);
+
+    /**
+     * Caps the active workers, whatever setActive() asks for (eg: an operator making room for other services).
+     */
+    void setLimit(int maxActive);
+
+    /**
+     * @return The workers not parked, ie: the smaller of the active workers and the limit.
+     */
+    int getActive() const;
+    int getLimit() const;
+
+    /**
+     * @return The active workers last set by setActive(), before the limit is applied.
+     */
+    int getRequested() const;
+
+    /**
+     * Releases every worker for good, so parked workers can see there is no work left and exit.
+     */
+    void finish();
+
+private:
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    int active;
+    int limit;
+    bool finished = false;
+};
+
+/**
+ * Watches cgroup cpu.stat, shrinking the active workers while the cgroup is throttled
+ * and growing them back (up to maxWorkers) once it is not.
+ */
+class ThrottleMonitor
+{
+public:
+    ThrottleMonitor(const CpuLimits & limits, WorkerGate & gate, int maxWorkers);
+    ~ThrottleMonitor();
+
+    /**
+     * Starts watching in a background thread, does nothing if there is no cgroup cpu.stat to watch.
+     */
+    void start();
+
+    void stop();
+
+private:
+    void run();
+
+    std::string cpuStatPath;
+    WorkerGate & gate;
+    int maxWorkers;
+
+    std::mutex lock;
+    std::condition_variable stopped;
+    bool stopRequested = false;
+    std::thread thread;
+};
+
+#endif //CRC_SENTENCES_CONCURRENCY_H
@@ -0,0 +1,75 @@
+/**
+ * @file concurrency_test.cpp
+ *
+ * Checks that workers parked by the throttle monitor while an operator limit is in force run again once the
+ * limit is raised. The cgroup is faked with a directory holding only cpu.stat.
+ */
+#include "concurrency.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void check(bool passed, const std::string & what)
+{
+    if(!passed) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static void writeThrottledTime(const std::string & cgroupDir, long long usec)
+{
+    std::ofstream cpuStat(cgroupDir + "/cpu.stat", std::ios::trunc);
+    cpuStat << "usage_usec 0\nthrottled_usec " << usec << "\n";
+}
+
+int main()
+{
+    char dir[] = "/tmp/concurrency_test_XXXXXX";
+    if(!mkdtemp(dir)) {
+        std::cerr << "Could not make a directory for the fake cgroup" << std::endl;
+        return 1;
+    }
+    CpuLimits limits;
+    limits.cgroupDir = dir;
+    writeThrottledTime(limits.cgroupDir, 0);
+
+    const int maxWorkers = 4;
+    WorkerGate gate(maxWorkers);
+    gate.setLimit(2);
+
+    // the fake cgroup is throttled until the monitor parks a worker.
+    ThrottleMonitor monitor(limits, gate, maxWorkers);
+    monitor.start();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    for(long long throttled = 0; gate.getRequested() == maxWorkers && std::chrono::steady_clock::now() < deadline; ) {
+        throttled += 1000 * 1000;
+        writeThrottledTime(limits.cgroupDir, throttled);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    monitor.stop();
+    check(gate.getRequested() == maxWorkers - 1, "the monitor parks a worker while throttled");
+    check(gate.getActive() == 2, "the operator limit still caps the workers");
+
+    // the operator raises the limit, only the worker the monitor parked stays parked.
+    gate.setLimit(maxWorkers);
+    check(gate.getActive() == maxWorkers - 1, "raising the limit brings back the workers the monitor did not park");
+    std::future<void> worker = std::async(std::launch::async, [&]{ gate.wait(maxWorkers - 2); });
+    check(worker.wait_for(std::chrono::seconds(1)) == std::future_status::ready, "a worker above the old limit runs");
+
+    gate.finish();
+    unlink((limits.cgroupDir + "/cpu.stat").c_str());
+    rmdir(dir);
+
+    if(failures == 0) {
+        std::cout << "concurrency: all checks passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file control.cpp
+ *
+ * Control socket, see control.h
+ */
+#include "control.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// How long a client has to send its request once connected.
+static const int requestTimeoutMs = 1000;
+
+ControlServer::ControlServer(const std::string & path, WorkerGate & gate, int maxWorkers)
+        : path(path), gate(gate), maxWorkers(maxWorkers), stopRequested(false)
+{
+}
+
+ControlServer::~ControlServer()
+{
+    stop();
+}
+
+bool ControlServer::start()
+{
+    sockaddr_un local = {};
+    local.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(local.sun_path)) {
+        std::cerr << "Control socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(local.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listenFd < 0 || bind(listenFd, (sockaddr *) &local, sizeof(local)) != 0 || listen(listenFd, 4) != 0) {
+        std::cerr << "Could not serve control on " << path << ": " << std::strerror(errno) << std::endl;
+        if(listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        return false;
+    }
+
+    thread = std::thread(&ControlServer::run, this);
+    return true;
+}
+
+void ControlServer::stop()
+{
+    stopRequested = true;
+    if(thread.joinable()) {
+        thread.join();
+    }
+    if(listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        unlink(path.c_str());
+    }
+}
+
+void ControlServer::run()
+{
+    while(!stopRequested)
+    {
+        // wake up now and then to see if we should stop.
+        pollfd listening = {listenFd, POLLIN, 0};
+        if(poll(&listening, 1, 250) <= 0) {
+            continue;
+        }
+        int connection = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(connection < 0) {
+            continue;
+        }
+
+        // read up to the end of the first line (or until the client stops sending).
+        std::string request;
+        pollfd readable = {connection, POLLIN, 0};
+        while(request.find('\n') == std::string::npos && request.size() < 256
+              && poll(&readable, 1, requestTimeoutMs) > 0) {
+            char buffer[256];
+            ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+            if(n <= 0) {
+                break;
+            }
+            request.append(buffer, (size_t) n);
+        }
+
+        std::string reply = answer(request.substr(0, request.find('\n')));
+        send(connection, reply.data(), reply.size(), MSG_NOSIGNAL);
+        close(connection);
+    }
+}
+
+std::string ControlServer::answer(const std::string & request)
+{
+    std::istringstream fields(request);
+    std::string command;
+    int workers;
+    fields >> command;
+    if(command != "workers") {
+        return "error: expected workers [count]\n";
+    }
+    if(fields >> workers) {
+        workers = std::max(0, std::min(workers, maxWorkers));
+        gate.setLimit(workers);
+        std::cout << "Worker limit set to " << workers << " by the control socket." << std::endl;
+    }
+    else if(!fields.eof()) {
+        return "error: the count must be a number\n";
+    }
+
+    int limit = gate.getLimit();
+    std::ostringstream reply;
+    reply << "workers " << gate.getActive() << " of " << maxWorkers << ", limit " << std::min(limit, maxWorkers)
+          << "\n";
+    return reply.str();
+}
@@ -0,0 +1,57 @@
+/**
+ * @file control.h
+ *
+ * Changes the number of workers of a running search, eg: to make room on a host needed by other services and
+ * give it back later, without restarting (and losing the progress of) the search. Workers over the limit park
+ * once their current chunk is done, the chunks left are taken by the workers still running.
+ *
+ * A request per connection to a Unix socket, a line of text answered by a line:
+ *
+ *     $ echo "workers 2" | socat - UNIX-CONNECT:/tmp/crc-control
+ *     workers 2 of 8, limit 2
+ *
+ * "workers" on its own reports the workers without changing them. The cgroup throttle monitor still parks
+ * workers under the limit if the cpu quota is being exceeded.
+ */
+#ifndef CRC_SENTENCES_CONTROL_H
+#define CRC_SENTENCES_CONTROL_H
+
+#include "concurrency.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+class ControlServer
+{
+public:
+    /**
+     * @param maxWorkers The worker threads started, the limit can be set from 0 (paused) to this.
+     */
+    ControlServer(const std::string & path, WorkerGate & gate, int maxWorkers);
+    ~ControlServer();
+
+    /**
+     * @return false if the socket could not be opened.
+     */
+    bool start();
+    void stop();
+
+private:
+    void run();
+
+    /**
+     * @return The reply to a request line.
+     */
+    std::string answer(const std::string & request);
+
+    std::string path;
+    WorkerGate & gate;
+    int maxWorkers;
+
+    int listenFd = -1;
+    std::thread thread;
+    std::atomic<bool> stopRequested;
+};
+
+#endif //CRC_SENTENCES_CONTROL_H
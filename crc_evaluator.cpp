@@ -0,0 +1,205 @@
+/**
+ * @file crc_evaluator.cpp
+ *
+ * Linear CRC evaluation and its code generation, see crc_evaluator.h
+ */
+#define CRCPP_USE_CPP11
+#include "3rd_party/CRC.h"
+#include "crc_evaluator.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/mman.h>
+
+LinearCRC makeLinearCRC(const SentenceTemplate & t)
+{
+    LinearCRC linear;
+    linear.base = t.calculateCRC(0);
+    for(int k=0; k<crcStringLength; k++) {
+        int shift = 4 * (crcStringLength - 1 - k);
+        for(uint32_t n=0; n<16; n++) {
+            linear.digits[k][n] = t.calculateCRC(n << shift) ^ linear.base;
+        }
+    }
+    return linear;
+}
+
+LinearCRC makeLinearCRC(const SentenceTemplate & t, const CRCParameters & parameters)
+{
+    CRC::Parameters<std::uint32_t, 32> p = {parameters.polynomial, parameters.initialValue, parameters.finalXOR,
+                                             parameters.reflectInput, parameters.reflectOutput};
+    CRC::Table<std::uint32_t, 32> table(p);
+    auto crcOf = [&](uint32_t value) {
+        std::string sentence = t.sentence(value);
+        return CRC::Calculate(sentence.c_str(), sentence.length(), table);
+    };
+
+    LinearCRC linear;
+    linear.base = crcOf(0);
+    for(int k=0; k<crcStringLength; k++) {
+        int shift = 4 * (crcStringLength - 1 - k);
+        for(uint32_t n=0; n<16; n++) {
+            linear.digits[k][n] = crcOf(n << shift) ^ linear.base;
+        }
+    }
+    return linear;
+}
+
+CaseRepair::CaseRepair(const SentenceTemplate & t, const CRCParameters & parameters)
+{
+    CRC::Parameters<std::uint32_t, 32> p = {parameters.polynomial, parameters.initialValue, parameters.finalXOR,
+                                             parameters.reflectInput, parameters.reflectOutput};
+    CRC::Table<std::uint32_t, 32> table(p);
+
+    // the change in CRC from flipping bit 5 (the case of a letter) of each character of the value.
+    std::string sentence = t.sentence(0);
+    uint32_t base = CRC::Calculate(sentence.c_str(), sentence.length(), table);
+    uint32_t flips[crcStringLength];
+    for(int k=0; k<crcStringLength; k++) {
+        std::string flipped = sentence;
+        flipped[t.prefix.size() + k] ^= 0x20;
+        flips[k] = CRC::Calculate(flipped.c_str(), flipped.length(), table) ^ base;
+    }
+
+    std::memset(filter, 0, sizeof(filter));
+    for(uint32_t subset=0; subset < (1u << crcStringLength); subset++)
+    {
+        uint32_t change = 0;
+        for(int k=0; k<crcStringLength; k++) {
+            if((subset >> k) & 1) {
+                change ^= flips[k];
+            }
+        }
+        subsets[subset] = {change, (uint8_t) subset};
+        uint32_t slot = (change * 0x9e3779b1u) >> (32 - filterBits);
+        filter[slot / 64] |= (uint64_t) 1 << (slot % 64);
+    }
+    std::sort(std::begin(subsets), std::end(subsets));
+}
+
+uint8_t CaseRepair::lookup(uint32_t error, uint8_t letters) const
+{
+    auto found = std::lower_bound(std::begin(subsets), std::end(subsets), std::make_pair(error, (uint8_t) 0));
+    for(; found != std::end(subsets) && found->first == error; ++found)
+    {
+        uint8_t flips = found->second;
+        if(flips != 0 && (flips & ~letters) == 0 && flips != letters) {
+            return flips;
+        }
+    }
+    return 0;
+}
+
+CRCCompiler::~CRCCompiler()
+{
+    if(memory) {
+        munmap(memory, size);
+    }
+}
+
+bool CRCCompiler::supported()
+{
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void put32(std::vector<uint8_t> & code, uint32_t value)
+{
+    for(int b=0; b<4; b++) {
+        code.push_back((uint8_t)(value >> (8 * b)));
+    }
+}
+
+static void patch32(std::vector<uint8_t> & code, size_t at, uint32_t value)
+{
+    for(int b=0; b<4; b++) {
+        code[at + b] = (uint8_t)(value >> (8 * b));
+    }
+}
+
+/**
+ * void evaluate(const uint32_t * values (rdi), uint32_t * crcs (rsi), size_t n (rdx)), System V ABI.
+ * The tables follow the code, addressed from r8.
+ */
+void CRCCompiler::add(CRCEvaluator & evaluator)
+{
+    const LinearCRC & linear = evaluator.linear;
+
+    // functions start on 16 bytes
+    while(code.size() % 16) {
+        code.push_back(0xcc);
+    }
+    entries.push_back({&evaluator, code.size()});
+
+    code.insert(code.end(), {0x48, 0x85, 0xd2});             // test rdx, rdx
+    size_t jumpToEnd = code.size();
+    code.insert(code.end(), {0x0f, 0x84, 0, 0, 0, 0});       // jz done
+    size_t loadTables = code.size();
+    code.insert(code.end(), {0x4c, 0x8d, 0x05, 0, 0, 0, 0}); // lea r8, [rip + tables]
+
+    size_t loop = code.size();
+    code.insert(code.end(), {0x44, 0x8b, 0x0f});             // mov r9d, [rdi]
+    code.push_back(0xb8);                                    // mov eax, base
+    put32(code, linear.base);
+    for(int k=0; k<crcStringLength; k++)
+    {
+        int shift = 4 * (crcStringLength - 1 - k);
+        code.insert(code.end(), {0x44, 0x89, 0xc9});         // mov ecx, r9d
+        if(shift) {
+            code.insert(code.end(), {0xc1, 0xe9, (uint8_t) shift});  // shr ecx, shift
+        }
+        if(k) {
+            code.insert(code.end(), {0x83, 0xe1, 0x0f});     // and ecx, 15
+        }
+        code.insert(code.end(), {0x41, 0x33, 0x84, 0x88});   // xor eax, [r8 + rcx*4 + k*64]
+        put32(code, (uint32_t)(k * 16 * sizeof(uint32_t)));
+    }
+    code.insert(code.end(), {0x89, 0x06});                   // mov [rsi], eax
+    code.insert(code.end(), {0x48, 0x83, 0xc7, 0x04});       // add rdi, 4
+    code.insert(code.end(), {0x48, 0x83, 0xc6, 0x04});       // add rsi, 4
+    code.insert(code.end(), {0x48, 0xff, 0xca});             // dec rdx
+    code.insert(code.end(), {0x0f, 0x85});                   // jnz loop
+    put32(code, (uint32_t)(loop - (code.size() + 4)));
+
+    patch32(code, jumpToEnd + 2, (uint32_t)(code.size() - (jumpToEnd + 6)));
+    code.push_back(0xc3);                                    // done: ret
+
+    // the tables, on their own cache lines
+    while(code.size() % 64) {
+        code.push_back(0xcc);
+    }
+    patch32(code, loadTables + 3, (uint32_t)(code.size() - (loadTables + 7)));
+    const uint8_t * tables = (const uint8_t *) linear.digits;
+    code.insert(code.end(), tables, tables + sizeof(linear.digits));
+}
+
+bool CRCCompiler::finish()
+{
+    if(!supported() || code.empty() || memory) {
+        return false;
+    }
+
+    // written while writable, then switched to executable (never both).
+    size = (code.size() + 4095) & ~(size_t) 4095;
+    void * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED) {
+        return false;
+    }
+    std::memcpy(mapping, code.data(), code.size());
+    if(mprotect(mapping, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapping, size);
+        return false;
+    }
+    memory = mapping;
+
+    for(const auto & entry : entries) {
+        entry.first->compiled = (CRCBatchFunction)((uint8_t *) memory + entry.second);
+    }
+    code.clear();
+    code.shrink_to_fit();
+    return true;
+}
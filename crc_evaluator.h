@@ -0,0 +1,205 @@
+/**
+ * @file crc_evaluator.h
+ *
+ * Fast CRC of a template's sentences, as a function of the value stated.
+ *
+ * A CRC is affine over GF(2): for a fixed length message, crc(a ^ b) = crc(a) ^ crc(b) ^ crc(0). Only the 8
+ * hex digits of a template's sentence change with the value, so its CRC can be written as
+ *
+ *     crc(value) = base ^ digits[0][nibble 0] ^ digits[1][nibble 1] ^ ... ^ digits[7][nibble 7]
+ *
+ * where base is the CRC of the sentence stating 0, and digits[k][n] is the change in CRC from putting digit n
+ * (in the template's case) at position k instead of '0'. This is 8 lookups per sentence, whatever the length,
+ * and holds for any CRC parameters.
+ *
+ * Consecutive values share their leading digits (the last digit changes every value, the one before every 16
+ * values, and so on), so a range of values keeps the CRC of each prefix of digits and only looks up the digits
+ * that changed, one lookup for most values.
+ *
+ * On x86-64 the evaluator of each template can also be compiled, with the base and table offsets folded into
+ * the machine code, to remove the remaining indirection from the inner loop. Elsewhere, or if memory cannot be
+ * made executable, the tables are interpreted.
+ */
+#ifndef CRC_SENTENCES_CRC_EVALUATOR_H
+#define CRC_SENTENCES_CRC_EVALUATOR_H
+
+#include "sentence.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * The CRC of a template's sentences, as a base CRC and the contribution of each digit.
+ */
+struct LinearCRC
+{
+    uint32_t base;                            // CRC of the sentence stating 0
+    uint32_t digits[crcStringLength][16];     // most significant digit first
+
+    uint32_t evaluate(uint32_t value) const
+    {
+        uint32_t crc = base;
+        for(int k=0; k<crcStringLength; k++) {
+            crc ^= digits[k][(value >> (4 * (crcStringLength - 1 - k))) & 0xf];
+        }
+        return crc;
+    }
+
+    /**
+     * CRCs of the n consecutive values from start, which may run up to and including 0xffffffff but not wrap.
+     */
+    void evaluateRange(uint32_t start, uint32_t * crcs, size_t n) const
+    {
+        const int last = crcStringLength - 1;
+
+        // prefix[k] is the CRC with digits 0 to k-1 of the current value applied.
+        uint32_t prefix[crcStringLength];
+        prefix[0] = base;
+        for(int k=0; k<last; k++) {
+            prefix[k + 1] = prefix[k] ^ digits[k][(start >> (4 * (last - k))) & 0xf];
+        }
+
+        uint32_t value = start;
+        size_t done = 0;
+        while(true)
+        {
+            // the last digit runs up to f before any other digit changes.
+            uint32_t low = value & 0xf;
+            size_t run = std::min((size_t)(16 - low), n - done);
+            for(size_t r=0; r<run; r++) {
+                crcs[done + r] = prefix[last] ^ digits[last][low + r];
+            }
+            done += run;
+            if(done == n) {
+                break;
+            }
+
+            // carry into the digits before, from the most significant one that changed.
+            value += (uint32_t) run;
+            int highestBit = 31 - __builtin_clz(value ^ (value - 1));
+            for(int k=last - highestBit / 4; k<last; k++) {
+                prefix[k + 1] = prefix[k] ^ digits[k][(value >> (4 * (last - k))) & 0xf];
+            }
+        }
+    }
+};
+
+LinearCRC makeLinearCRC(const SentenceTemplate & t);
+
+/**
+ * The same, under other CRC parameters than the ones being searched.
+ */
+LinearCRC makeLinearCRC(const SentenceTemplate & t, const CRCParameters & parameters);
+
+/**
+ * Turns misses into hits by changing the case of letters in the value stated, which still states the same value.
+ *
+ * By linearity, flipping the case of character k of the value changes the CRC by flips[k] whatever the value, so
+ * the sentence stating value is a hit with the letters in some subset flipped if crc ^ value is the XOR of their
+ * flips. The XOR of every subset is kept, sorted, behind a bit filter so most misses are ruled out by one lookup.
+ */
+class CaseRepair
+{
+public:
+    /**
+     * @param t A lower case template.
+     */
+    CaseRepair(const SentenceTemplate & t, const CRCParameters & parameters);
+
+    /**
+     * @return The characters to flip (bit k for character k) for the sentence stating value to have a CRC of
+     *         value, 0 if there are none. All of the letters are never flipped, that is the upper case sentence.
+     */
+    uint8_t repair(uint32_t value, uint32_t crc) const
+    {
+        uint32_t error = value ^ crc;
+        uint32_t slot = (error * 0x9e3779b1u) >> (32 - filterBits);
+        if(((filter[slot / 64] >> (slot % 64)) & 1) == 0) {
+            return 0;
+        }
+        return lookup(error, hexLetterMask(value));
+    }
+
+private:
+    static const int filterBits = 15;
+
+    uint8_t lookup(uint32_t error, uint8_t letters) const;
+
+    uint64_t filter[(1 << filterBits) / 64];
+    std::pair<uint32_t, uint8_t> subsets[1 << crcStringLength];  // XOR of the flips of each subset, and the subset
+};
+
+/**
+ * CRCs a batch of values, compiled machine code (see CRCCompiler) or interpreted.
+ */
+typedef void (*CRCBatchFunction)(const uint32_t * values, uint32_t * crcs, size_t n);
+
+struct CRCEvaluator
+{
+    explicit CRCEvaluator(const LinearCRC & linear) : linear(linear) { }
+
+    void evaluate(const uint32_t * values, uint32_t * crcs, size_t n) const
+    {
+        if(compiled) {
+            compiled(values, crcs, n);
+            return;
+        }
+        for(size_t k=0; k<n; k++) {
+            crcs[k] = linear.evaluate(values[k]);
+        }
+    }
+
+    /**
+     * CRCs of the n consecutive values from start, see LinearCRC::evaluateRange.
+     */
+    void evaluateRange(uint32_t start, uint32_t * crcs, size_t n) const
+    {
+        linear.evaluateRange(start, crcs, n);
+    }
+
+    LinearCRC linear;
+    CRCBatchFunction compiled = nullptr;
+};
+
+/**
+ * Generates x86-64 code for evaluators into one executable mapping, which lives as long as the compiler.
+ */
+class CRCCompiler
+{
+public:
+    CRCCompiler() = default;
+    ~CRCCompiler();
+
+    CRCCompiler(const CRCCompiler &) = delete;
+    CRCCompiler & operator=(const CRCCompiler &) = delete;
+
+    /**
+     * @return true if code can be generated for this cpu.
+     */
+    static bool supported();
+
+    /**
+     * Generates the code of an evaluator, which is compiled once finish() is called.
+     * The evaluator must not move in memory until then.
+     */
+    void add(CRCEvaluator & evaluator);
+
+    /**
+     * Makes the code executable and points the evaluators at it.
+     * @return false if that was not possible, the evaluators keep interpreting.
+     */
+    bool finish();
+
+    size_t codeSize() const { return size; }
+
+private:
+    std::vector<uint8_t> code;
+    std::vector<std::pair<CRCEvaluator *, size_t>> entries;  // evaluator, offset of its code
+    void * memory = nullptr;
+    size_t size = 0;
+};
+
+#endif //CRC_SENTENCES_CRC_EVALUATOR_H
@@ -0,0 +1,154 @@
+/**
+ * @file crc_parameters.cpp
+ *
+ * Runtime CRC parameters, see crc_parameters.h
+ */
+#include "crc_parameters.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+/**
+ * The 32 bit CRCs of the CRC RevEng catalogue that are in common use.
+ */
+struct NamedCRC
+{
+    const char * name;
+    CRCParameters parameters;
+};
+
+static const NamedCRC namedCRCs[] = {
+    {"crc32",        {0x04c11db7, 0xffffffff, 0xffffffff, true, true}},
+    {"crc32-bzip2",  {0x04c11db7, 0xffffffff, 0xffffffff, false, false}},
+    {"crc32c",       {0x1edc6f41, 0xffffffff, 0xffffffff, true, true}},
+    {"crc32d",       {0xa833982b, 0xffffffff, 0xffffffff, true, true}},
+    {"crc32-jamcrc", {0x04c11db7, 0xffffffff, 0x00000000, true, true}},
+    {"crc32-mpeg2",  {0x04c11db7, 0xffffffff, 0x00000000, false, false}},
+    {"crc32-posix",  {0x04c11db7, 0x00000000, 0xffffffff, false, false}},
+    {"crc32q",       {0x814141ab, 0x00000000, 0x00000000, false, false}},
+    {"crc32-xfer",   {0x000000af, 0x00000000, 0x00000000, false, false}},
+};
+
+/**
+ * Converts init between RevEng's convention and CRC++'s register, which for refin=1 shifts right so holds the
+ * bits reflected. Converting twice gives back the value.
+ */
+static uint32_t convertInitialValue(uint32_t init, bool reflectInput)
+{
+    if(!reflectInput) {
+        return init;
+    }
+    uint32_t reflected = 0;
+    for(int b=0; b<32; b++) {
+        reflected |= ((init >> b) & 1) << (31 - b);
+    }
+    return reflected;
+}
+
+static bool parseNumber(const std::string & text, uint32_t & value)
+{
+    char * end = nullptr;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, 0);
+    if(text.empty() || *end != '\0' || parsed > 0xffffffffULL) {
+        return false;
+    }
+    value = (uint32_t) parsed;
+    return true;
+}
+
+static bool parseFlag(const std::string & text, bool & value)
+{
+    if(text == "1" || text == "true") {
+        value = true;
+        return true;
+    }
+    if(text == "0" || text == "false") {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+bool parseCRCParameters(const std::string & text, CRCParameters & parameters, std::ostream & error)
+{
+    for(const NamedCRC & named : namedCRCs) {
+        if(text == named.name) {
+            parameters = named.parameters;
+            parameters.initialValue = convertInitialValue(parameters.initialValue, parameters.reflectInput);
+            return true;
+        }
+    }
+
+    // a list of field=value
+    CRCParameters parsed;
+    std::istringstream fields(text);
+    std::string field;
+    while(std::getline(fields, field, ','))
+    {
+        size_t equals = field.find('=');
+        std::string key = field.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+
+        bool ok;
+        if(key == "poly") {
+            ok = parseNumber(value, parsed.polynomial);
+        }
+        else if(key == "init") {
+            ok = parseNumber(value, parsed.initialValue);
+        }
+        else if(key == "xorout") {
+            ok = parseNumber(value, parsed.finalXOR);
+        }
+        else if(key == "refin") {
+            ok = parseFlag(value, parsed.reflectInput);
+        }
+        else if(key == "refout") {
+            ok = parseFlag(value, parsed.reflectOutput);
+        }
+        else if(key == "width") {
+            ok = value == "32";
+        }
+        else {
+            error << "Unknown CRC " << text << ", expected one of:";
+            for(const NamedCRC & named : namedCRCs) {
+                error << " " << named.name;
+            }
+            error << ", or a list of poly=,init=,xorout=,refin=,refout=" << std::endl;
+            return false;
+        }
+
+        if(!ok) {
+            error << "Bad CRC parameter " << field << " (only 32 bit CRCs can be searched)" << std::endl;
+            return false;
+        }
+    }
+
+    // refin may come after init in the list, so init is converted once every field is known.
+    parsed.initialValue = convertInitialValue(parsed.initialValue, parsed.reflectInput);
+    parameters = parsed;
+    return true;
+}
+
+void printCRCParameters(const CRCParameters & parameters, std::ostream & out)
+{
+    // formatted separately, so the thousands separators of the console do not end up in the hex.
+    std::ostringstream text;
+    text.imbue(std::locale::classic());
+    text << "CRC poly=0x" << std::hex << std::setfill('0') << std::setw(8) << parameters.polynomial
+         << ",init=0x" << std::setw(8) << convertInitialValue(parameters.initialValue, parameters.reflectInput)
+         << ",xorout=0x" << std::setw(8) << parameters.finalXOR
+         << ",refin=" << parameters.reflectInput << ",refout=" << parameters.reflectOutput;
+    out << text.str();
+
+    for(const NamedCRC & named : namedCRCs) {
+        const CRCParameters & p = named.parameters;
+        if(p.polynomial == parameters.polynomial
+           && convertInitialValue(p.initialValue, p.reflectInput) == parameters.initialValue
+           && p.finalXOR == parameters.finalXOR && p.reflectInput == parameters.reflectInput
+           && p.reflectOutput == parameters.reflectOutput) {
+            out << " (" << named.name << ")";
+        }
+    }
+    out << std::endl;
+}
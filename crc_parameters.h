@@ -0,0 +1,46 @@
+/**
+ * @file crc_parameters.h
+ *
+ * 32 bit CRC parameters chosen at runtime, so proprietary CRCs can be searched without recompiling.
+ *
+ * Parameters are given on the command line as a name, or as a list of fields:
+ *
+ *     --crc crc32c
+ *     --crc poly=0x1edc6f41,init=0xffffffff,xorout=0xffffffff,refin=1,refout=1
+ *
+ * Fields left out of a list take the value of CRC-32 (the default). As in the CRC RevEng catalogue, init is the
+ * register before any input in unreflected bit order, whatever refin is.
+ */
+#ifndef CRC_SENTENCES_CRC_PARAMETERS_H
+#define CRC_SENTENCES_CRC_PARAMETERS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Same fields as CRC::Parameters, kept separate so CRC.h is only included where the tables are made.
+ * initialValue is in CRC++'s convention, loaded into the register as is, so it is the reflection of RevEng's
+ * init if reflectInput is set (parseCRCParameters and printCRCParameters convert).
+ */
+struct CRCParameters
+{
+    uint32_t polynomial = 0x04c11db7;
+    uint32_t initialValue = 0xffffffff;
+    uint32_t finalXOR = 0xffffffff;
+    bool reflectInput = true;
+    bool reflectOutput = true;
+};
+
+/**
+ * Parses a parameter set name or list of fields.
+ * @return false (with the reason written to error) if the text is not understood.
+ */
+bool parseCRCParameters(const std::string & text, CRCParameters & parameters, std::ostream & error);
+
+/**
+ * Writes the parameters, and the names they can be given by.
+ */
+void printCRCParameters(const CRCParameters & parameters, std::ostream & out);
+
+#endif //CRC_SENTENCES_CRC_PARAMETERS_H
@@ -0,0 +1,64 @@
+/**
+ * @file crc_parameters_test.cpp
+ *
+ * Checks that CRCs given as fields are calculated as the CRC RevEng catalogue defines them, including an init
+ * that is not a palindrome with refin=1. Expected values are from a bit by bit MSB first reference.
+ */
+#include "crc_parameters.h"
+#include "sentence.h"
+#include "verify.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool passed, const std::string & what)
+{
+    if(!passed) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * Checks the CRC of "123456789" (the catalogue's check value) with CRC++ and with the sliced CRC of --verify.
+ */
+static void checkCRC(const std::string & text, uint32_t expected)
+{
+    CRCParameters parameters;
+    std::ostringstream error;
+    if(!parseCRCParameters(text, parameters, error)) {
+        check(false, "parse " + text + ": " + error.str());
+        return;
+    }
+
+    const std::string data = "123456789";
+    setCRCParameters(parameters);
+    check(calculateCRC(data) == expected, "CRC++ check value of " + text);
+    check(SlicedCRC(parameters).calculate(data.data(), data.size()) == expected, "sliced check value of " + text);
+
+    // printed as given, not as the register.
+    std::ostringstream printed;
+    printCRCParameters(parameters, printed);
+    CRCParameters reparsed;
+    std::string fields = printed.str().substr(4, printed.str().find_first_of(" \n", 4) - 4);
+    check(parseCRCParameters(fields, reparsed, error) && reparsed.initialValue == parameters.initialValue,
+          "printed parameters of " + text + " parse back the same");
+}
+
+int main()
+{
+    checkCRC("crc32", 0xcbf43926);
+    checkCRC("crc32-bzip2", 0xfc891918);
+    checkCRC("poly=0x04c11db7,init=0x12345678,xorout=0,refin=1,refout=1", 0xf0748bce);
+    checkCRC("poly=0x04c11db7,init=0x12345678,xorout=0,refout=0,refin=1", 0x73d12e0f);
+    checkCRC("poly=0x04c11db7,init=0x12345678,xorout=0,refin=0,refout=0", 0xebc418c4);
+    checkCRC("poly=0x1edc6f41,init=0x0000ffff,xorout=0xffffffff,refin=1,refout=1", 0x6bb616ac);
+
+    if(failures == 0) {
+        std::cout << "crc parameters: all checks passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
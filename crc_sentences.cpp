@@ -0,0 +1,385 @@
+/**
+ * @file crc_sentences.cpp
+ *
+ * The C interface, see crc_sentences.h
+ */
+#include "crc_sentences.h"
+#include "concurrency.h"
+#include "search.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Values of i in a chunk of work, small enough that a cancelled search stops quickly.
+static const uint32_t apiChunkSize = 1 << 16;
+
+// Values of i tested per template before moving on to the next (see tuneTileSize).
+static const uint32_t apiTileSize = 4096;
+
+// Result batches a search can queue before its workers wait to be polled.
+static const size_t apiQueueCapacity = 1024;
+
+static thread_local std::string lastError;
+
+static void setError(const std::string & error)
+{
+    lastError = error;
+}
+
+/**
+ * Queues a search's results for polling.
+ */
+class QueueSink : public ResultSink
+{
+public:
+    explicit QueueSink(BoundedQueue<ResultBatch> & queue) : queue(queue) { }
+
+    void emit(ResultBatch && batch) override
+    {
+        // a cancelled search's queue is closed, its results are dropped.
+        if(!batch.empty()) {
+            queue.push(std::move(batch));
+        }
+    }
+
+private:
+    BoundedQueue<ResultBatch> & queue;
+};
+
+/**
+ * A search, shared by its handle and the engine's workers.
+ */
+struct ApiSearch
+{
+    ApiSearch() : queue(apiQueueCapacity), sink(queue) { }
+
+    SearchModel model;
+    std::unique_ptr<FamilyScheduler> scheduler;
+    BoundedQueue<ResultBatch> queue;
+    QueueSink sink;
+
+    // guards the state below
+    std::mutex lock;
+    bool handedOut = false;     // every chunk has been handed out
+    bool cancelled = false;
+    bool done = false;          // every chunk has completed
+    uint64_t inFlight = 0;
+    uint64_t candidates = 0;
+    uint64_t hits = 0;
+    uint64_t nearMisses = 0;
+
+    // the batch being polled, and how much of it has been
+    std::mutex pollLock;
+    ResultBatch polling;
+    size_t polled = 0;
+};
+
+struct crcs_search
+{
+    std::shared_ptr<ApiSearch> search;
+};
+
+struct crcs_engine
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::shared_ptr<ApiSearch>> searches;  // searches with chunks still to hand out
+    std::vector<std::weak_ptr<ApiSearch>> live;         // every search submitted, to cancel them all on destroy
+    size_t nextSearch = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+/**
+ * Takes a chunk from the next search round robin, dropping searches with nothing left to hand out.
+ * Called with the engine locked.
+ */
+static bool takeChunk(crcs_engine & engine, std::shared_ptr<ApiSearch> & taken, WorkChunk & chunk)
+{
+    while(!engine.searches.empty())
+    {
+        size_t k = engine.nextSearch % engine.searches.size();
+        std::shared_ptr<ApiSearch> search = engine.searches[k];
+
+        std::lock_guard<std::mutex> guard(search->lock);
+        if(!search->cancelled && search->scheduler->next(chunk)) {
+            search->inFlight++;
+            engine.nextSearch = k + 1;
+            taken = search;
+            return true;
+        }
+
+        search->handedOut = true;
+        if(search->inFlight == 0 && !search->cancelled) {
+            search->done = true;
+            search->queue.close();
+        }
+        engine.searches.erase(engine.searches.begin() + k);
+    }
+    return false;
+}
+
+static void completeChunk(ApiSearch & search, const WorkChunk & chunk, const ChunkResult & result)
+{
+    search.scheduler->complete(chunk, result);
+
+    std::lock_guard<std::mutex> guard(search.lock);
+    search.inFlight--;
+    search.candidates += result.candidates;
+    search.hits += result.hits;
+    search.nearMisses += result.nearMisses;
+    if(search.handedOut && search.inFlight == 0 && !search.cancelled) {
+        search.done = true;
+        search.queue.close();
+    }
+}
+
+static void apiWorker(crcs_engine & engine)
+{
+    while(true)
+    {
+        std::shared_ptr<ApiSearch> search;
+        WorkChunk chunk;
+        {
+            std::unique_lock<std::mutex> guard(engine.lock);
+            engine.changed.wait(guard, [&]{ return engine.stopping || takeChunk(engine, search, chunk); });
+            if(!search) {
+                return;
+            }
+        }
+
+        ChunkResult result = testSentences(search->model, chunk.start_inc, chunk.end_ex, chunk.family, apiTileSize,
+                                           &search->sink);
+        completeChunk(*search, chunk, result);
+    }
+}
+
+static void cancelSearch(ApiSearch & search)
+{
+    std::lock_guard<std::mutex> guard(search.lock);
+    if(!search.done) {
+        search.cancelled = true;
+    }
+    // workers blocked on a full queue are released, their results dropped.
+    search.queue.close();
+}
+
+int crcs_api_version(void)
+{
+    return CRCS_API_VERSION;
+}
+
+const char * crcs_last_error(void)
+{
+    return lastError.c_str();
+}
+
+crcs_engine * crcs_engine_create(int threads)
+{
+    if(threads < 0) {
+        setError("threads must not be negative");
+        return nullptr;
+    }
+    if(threads == 0) {
+        // as the executable, no more than the affinity mask and cgroup quota let run at once.
+        threads = detectCpuLimits().usableThreads();
+    }
+
+    try {
+        std::unique_ptr<crcs_engine> engine(new crcs_engine());
+        for(int t=0; t<threads; t++) {
+            engine->workers.emplace_back(apiWorker, std::ref(*engine));
+        }
+        return engine.release();
+    }
+    catch(const std::exception & e) {
+        setError(std::string("could not start the workers: ") + e.what());
+        return nullptr;
+    }
+}
+
+void crcs_engine_destroy(crcs_engine * engine)
+{
+    if(!engine) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(engine->lock);
+        engine->stopping = true;
+        // including searches fully handed out, whose workers may be blocked on a full queue.
+        for(std::weak_ptr<ApiSearch> & live : engine->live) {
+            if(std::shared_ptr<ApiSearch> search = live.lock()) {
+                cancelSearch(*search);
+            }
+        }
+        engine->searches.clear();
+        engine->live.clear();
+        engine->changed.notify_all();
+    }
+    for(std::thread & worker : engine->workers) {
+        worker.join();
+    }
+    delete engine;
+}
+
+void crcs_search_options_init(crcs_search_options * options)
+{
+    if(!options) {
+        return;
+    }
+    std::memset(options, 0, sizeof(*options));
+    options->struct_size = sizeof(*options);
+    options->start = 0;
+    options->length = 0x100000000ULL;
+    options->family_mask = allSentenceFamilies;
+    options->near_miss_distance = 25;
+    options->match_bits = 32;
+}
+
+crcs_search * crcs_search_submit(crcs_engine * engine, const crcs_search_options * options)
+{
+    if(!engine || !options || options->struct_size < sizeof(crcs_search_options)) {
+        setError("no engine, or options not made by crcs_search_options_init");
+        return nullptr;
+    }
+    if(options->length == 0 || (uint64_t) options->start + options->length > 0x100000000ULL) {
+        setError("the range of i is empty or goes past 0xffffffff");
+        return nullptr;
+    }
+    if((options->family_mask & allSentenceFamilies) == 0 || (options->family_mask & ~allSentenceFamilies) != 0) {
+        setError("family_mask has no families, or families that do not exist");
+        return nullptr;
+    }
+    if(options->match_bits < 24 || options->match_bits > 32 || options->near_miss_distance < 0) {
+        setError("match_bits must be 24 to 32, and near_miss_distance not negative");
+        return nullptr;
+    }
+
+    try {
+        std::shared_ptr<ApiSearch> search = std::make_shared<ApiSearch>();
+        SearchModel & model = search->model;
+        if(options->hash && !parseHashFunction(options->hash, model.hashFunction)) {
+            setError(std::string("unknown hash ") + options->hash);
+            return nullptr;
+        }
+        CRCParameters parameters;
+        std::ostringstream error;
+        if(options->crc && !parseCRCParameters(options->crc, parameters, error)) {
+            setError(error.str());
+            return nullptr;
+        }
+        model.nearMissDistance = options->near_miss_distance;
+        model.matchBits = options->match_bits;
+        buildTemplates(model, parameters, nullptr);
+        search->scheduler.reset(new FamilyScheduler(options->start, options->length, apiChunkSize,
+                                                    options->family_mask));
+
+        std::unique_ptr<crcs_search> handle(new crcs_search{search});
+        {
+            std::lock_guard<std::mutex> guard(engine->lock);
+            if(engine->stopping) {
+                setError("the engine is being destroyed");
+                return nullptr;
+            }
+            engine->live.erase(std::remove_if(engine->live.begin(), engine->live.end(),
+                                              [](const std::weak_ptr<ApiSearch> & live) { return live.expired(); }),
+                               engine->live.end());
+            engine->live.push_back(search);
+            engine->searches.push_back(search);
+            engine->changed.notify_all();
+        }
+        return handle.release();
+    }
+    catch(const std::exception & e) {
+        setError(std::string("could not start the search: ") + e.what());
+        return nullptr;
+    }
+}
+
+long crcs_search_poll(crcs_search * search, crcs_result * results, size_t capacity, int timeout_ms)
+{
+    if(!search || (!results && capacity > 0)) {
+        setError("no search, or no buffer for the results");
+        return -1;
+    }
+    ApiSearch & s = *search->search;
+    std::lock_guard<std::mutex> guard(s.pollLock);
+
+    if(s.polled == s.polling.size())
+    {
+        s.polling.clear();
+        s.polled = 0;
+        bool popped = timeout_ms < 0 ? s.queue.pop(s.polling)
+                                     : s.queue.popFor(s.polling, std::chrono::milliseconds(timeout_ms));
+        if(!popped) {
+            return s.queue.isClosed() && s.queue.size() == 0 ? -1 : 0;
+        }
+    }
+
+    size_t n = std::min(capacity, s.polling.size() - s.polled);
+    for(size_t k=0; k<n; k++)
+    {
+        const SearchResult & found = s.polling[s.polled + k];
+        results[k].value = found.i;
+        results[k].hash = found.crc;
+        results[k].operation = found.operation;
+        results[k].upper_case = found.upperCase ? 1 : 0;
+        results[k].case_flips = found.caseFlips;
+        results[k].hit = found.hit ? 1 : 0;
+    }
+    s.polled += n;
+    return (long) n;
+}
+
+int crcs_search_stats_get(crcs_search * search, crcs_search_stats * stats)
+{
+    if(!search || !stats || stats->struct_size < sizeof(crcs_search_stats)) {
+        setError("no search, or stats without struct_size set");
+        return -1;
+    }
+    ApiSearch & s = *search->search;
+    std::lock_guard<std::mutex> guard(s.lock);
+    stats->status = s.cancelled ? CRCS_CANCELLED : s.done ? CRCS_DONE : CRCS_RUNNING;
+    stats->percent_complete = s.scheduler->percentComplete();
+    stats->candidates = s.candidates;
+    stats->hits = s.hits;
+    stats->near_misses = s.nearMisses;
+    return 0;
+}
+
+size_t crcs_sentence(const crcs_result * result, char * buffer, size_t size)
+{
+    if(!result) {
+        return 0;
+    }
+    char crcString[crcStringLength];
+    writeCRCString(result->value, result->upper_case != 0, crcString);
+    flipCRCStringCase(result->case_flips, crcString);
+    std::string sentence = generateSentence(result->operation, std::string(crcString, crcStringLength));
+    if(buffer && size > 0) {
+        size_t n = std::min(sentence.size(), size - 1);
+        std::memcpy(buffer, sentence.data(), n);
+        buffer[n] = '\0';
+    }
+    return sentence.size();
+}
+
+void crcs_search_cancel(crcs_search * search)
+{
+    if(search) {
+        cancelSearch(*search->search);
+    }
+}
+
+void crcs_search_release(crcs_search * search)
+{
+    if(search) {
+        cancelSearch(*search->search);
+        delete search;
+    }
+}
@@ -0,0 +1,158 @@
+/**
+ * @file crc_sentences.h
+ *
+ * C interface of the search, built as the crcSentences shared library, so other languages (eg: Python's ctypes,
+ * Go's cgo) get results without running the executable and parsing its output.
+ *
+ * An engine owns a pool of worker threads, searches submitted to it share the workers round robin. Results are
+ * queued per search and copied out into the caller's buffer by crcs_search_poll(). A search that is not polled
+ * eventually fills its queue, which holds up the workers (as the console does for the executable), so poll
+ * regularly or cancel the search.
+ *
+ *     crcs_engine * engine = crcs_engine_create(0);
+ *     crcs_search_options options;
+ *     crcs_search_options_init(&options);
+ *     crcs_search * search = crcs_search_submit(engine, &options);
+ *     crcs_result results[64];
+ *     long n;
+ *     while((n = crcs_search_poll(search, results, 64, 1000)) >= 0) { ... }
+ *     crcs_search_release(search);
+ *     crcs_engine_destroy(engine);
+ *
+ * Functions returning a pointer return NULL on failure, and functions returning int return a negative value,
+ * crcs_last_error() then says why.
+ */
+#ifndef CRC_SENTENCES_C_API_H
+#define CRC_SENTENCES_C_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CRCS_BUILDING_LIBRARY)
+#define CRCS_EXPORT __attribute__((visibility("default")))
+#else
+#define CRCS_EXPORT
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Changes when a struct or function changes incompatibly.
+#define CRCS_API_VERSION 2
+
+typedef struct crcs_engine crcs_engine;
+typedef struct crcs_search crcs_search;
+
+/**
+ * What to search, fill in with crcs_search_options_init() before changing any fields.
+ * struct_size lets later versions of the library add fields.
+ */
+typedef struct crcs_search_options
+{
+    size_t struct_size;
+    const char * hash;          // a hash name (as --hash), NULL for a CRC
+    const char * crc;           // the CRC (as --crc), NULL for CRC-32
+    uint32_t start;             // first value of i
+    uint64_t length;            // number of values of i, from start
+    uint32_t family_mask;       // bit f set to search sentence family f
+    int near_miss_distance;     // results within +/- this are near misses, 0 for hits only
+    int match_bits;             // leading bits of the hash that must match for a hit, 24 to 32
+} crcs_search_options;
+
+/**
+ * A hit or near miss, crcs_sentence() gives its text.
+ */
+typedef struct crcs_result
+{
+    uint32_t value;             // the value stated by the sentence
+    uint32_t hash;              // the actual hash of the sentence
+    uint16_t operation;         // opcode of the sentence
+    uint8_t upper_case;         // case of the value in the sentence
+    uint8_t hit;                // 1 for a hit, 0 for a near miss
+    uint8_t case_flips;         // bit k set if character k of the value is in the other case
+} crcs_result;
+
+typedef enum crcs_status
+{
+    CRCS_RUNNING = 0,
+    CRCS_DONE = 1,              // every value was searched
+    CRCS_CANCELLED = 2
+} crcs_status;
+
+/**
+ * Progress of a search.
+ */
+typedef struct crcs_search_stats
+{
+    size_t struct_size;         // set by the caller
+    crcs_status status;
+    int percent_complete;
+    uint64_t candidates;
+    uint64_t hits;
+    uint64_t near_misses;
+} crcs_search_stats;
+
+/**
+ * @return CRCS_API_VERSION of the library.
+ */
+CRCS_EXPORT int crcs_api_version(void);
+
+/**
+ * @return Why the last call on this thread failed.
+ */
+CRCS_EXPORT const char * crcs_last_error(void);
+
+/**
+ * @param threads Worker threads, 0 for one per cpu the process may use (its affinity and cgroup cpu quota).
+ */
+CRCS_EXPORT crcs_engine * crcs_engine_create(int threads);
+
+/**
+ * Cancels any searches still running and stops the workers. Searches must still be released.
+ */
+CRCS_EXPORT void crcs_engine_destroy(crcs_engine * engine);
+
+/**
+ * Sets the options to a full CRC-32 search with near misses.
+ */
+CRCS_EXPORT void crcs_search_options_init(crcs_search_options * options);
+
+/**
+ * Starts a search, the sentence templates are made before it returns.
+ */
+CRCS_EXPORT crcs_search * crcs_search_submit(crcs_engine * engine, const crcs_search_options * options);
+
+/**
+ * Copies up to capacity results into results, waiting up to timeout_ms (-1 for no limit) for there to be any.
+ * @return The number of results copied (0 if there were none in time), or -1 once the search has finished and
+ *         every result has been polled.
+ */
+CRCS_EXPORT long crcs_search_poll(crcs_search * search, crcs_result * results, size_t capacity, int timeout_ms);
+
+/**
+ * Fills in stats, whose struct_size must be set.
+ */
+CRCS_EXPORT int crcs_search_stats_get(crcs_search * search, crcs_search_stats * stats);
+
+/**
+ * Writes the sentence of a result to buffer (nul terminated, truncated to size).
+ * @return The length of the sentence, as snprintf.
+ */
+CRCS_EXPORT size_t crcs_sentence(const crcs_result * result, char * buffer, size_t size);
+
+/**
+ * Stops handing out work for the search, results already queued can still be polled.
+ */
+CRCS_EXPORT void crcs_search_cancel(crcs_search * search);
+
+/**
+ * Cancels the search if it is still running, and frees it.
+ */
+CRCS_EXPORT void crcs_search_release(crcs_search * search);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CRC_SENTENCES_C_API_H
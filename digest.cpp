@@ -0,0 +1,158 @@
+/**
+ * @file digest.cpp
+ *
+ * Chunk digests, see digest.h
+ */
+#include "digest.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+static const uint64_t fnvOffsetBasis = 0xcbf29ce484222325ULL;
+static const uint64_t fnvPrime = 0x100000001b3ULL;
+
+/**
+ * Adds the bytes of value to an FNV-1a hash, least significant first so the hash is the same on any host.
+ */
+static uint64_t hashValue(uint64_t hash, uint32_t value, int bytes)
+{
+    for(int b=0; b<bytes; b++) {
+        hash = (hash ^ ((value >> (8 * b)) & 0xff)) * fnvPrime;
+    }
+    return hash;
+}
+
+void DigestingSink::emit(ResultBatch && batch)
+{
+    results.insert(results.end(), batch.begin(), batch.end());
+    next.emit(std::move(batch));
+}
+
+ChunkDigest DigestingSink::finishChunk(const WorkChunk & chunk, const ChunkResult & result)
+{
+    std::sort(results.begin(), results.end(), resultOrder);
+
+    ChunkDigest digest;
+    digest.chunk = chunk;
+    digest.hits = result.hits;
+    digest.nearMisses = result.nearMisses;
+    digest.hash = fnvOffsetBasis;
+    for(const SearchResult & found : results)
+    {
+        digest.hash = hashValue(digest.hash, found.i, 4);
+        digest.hash = hashValue(digest.hash, found.crc, 4);
+        digest.hash = hashValue(digest.hash, found.operation, 2);
+        digest.hash = hashValue(digest.hash, found.upperCase ? 1 : 0, 1);
+        if(found.caseFlips) {
+            digest.hash = hashValue(digest.hash, found.caseFlips, 1);
+        }
+    }
+    results.clear();
+    return digest;
+}
+
+DigestWriter::DigestWriter(const std::string & path) : file(path, std::ios::out | std::ios::trunc)
+{
+    if(!file) {
+        std::cerr << "Could not write " << path << std::endl;
+    }
+}
+
+void DigestWriter::write(const ChunkDigest & digest)
+{
+    // a line is written in one go, so a run that is killed leaves whole lines behind.
+    std::ostringstream line;
+    line << digest.chunk.family << " " << digest.chunk.start_inc << " " << digest.chunk.end_ex << " "
+         << digest.hits << " " << digest.nearMisses << " "
+         << std::hex << std::setw(16) << std::setfill('0') << digest.hash << "\n";
+
+    std::lock_guard<std::mutex> guard(lock);
+    file << line.str();
+    file.flush();
+}
+
+bool DigestWriter::close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    file.close();
+    return !file.fail();
+}
+
+typedef std::tuple<int, uint32_t, uint64_t> ChunkKey;
+
+static bool readDigestFile(const std::string & path, std::map<ChunkKey, ChunkDigest> & digests)
+{
+    std::ifstream file(path);
+    if(!file) {
+        return false;
+    }
+    std::string line;
+    while(std::getline(file, line))
+    {
+        ChunkDigest digest;
+        std::istringstream fields(line);
+        if(fields >> digest.chunk.family >> digest.chunk.start_inc >> digest.chunk.end_ex
+                  >> digest.hits >> digest.nearMisses >> std::hex >> digest.hash) {
+            digests[ChunkKey(digest.chunk.family, digest.chunk.start_inc, digest.chunk.end_ex)] = digest;
+        }
+    }
+    return true;
+}
+
+static void printDigest(const ChunkDigest & digest, std::ostream & out)
+{
+    out << "family " << digest.chunk.family << " [" << digest.chunk.start_inc << ", " << digest.chunk.end_ex << "): "
+        << digest.hits << " hits, " << digest.nearMisses << " near misses, hash "
+        << std::hex << std::setw(16) << std::setfill('0') << digest.hash << std::dec << std::setfill(' ');
+}
+
+int compareDigestFiles(const std::string & pathA, const std::string & pathB, std::ostream & out)
+{
+    std::map<ChunkKey, ChunkDigest> a, b;
+    if(!readDigestFile(pathA, a)) {
+        std::cerr << "Could not read " << pathA << std::endl;
+        return 1;
+    }
+    if(!readDigestFile(pathB, b)) {
+        std::cerr << "Could not read " << pathB << std::endl;
+        return 1;
+    }
+
+    uint64_t matching = 0, differing = 0, onlyA = 0, onlyB = 0;
+    for(const auto & entry : a)
+    {
+        auto other = b.find(entry.first);
+        if(other == b.end()) {
+            onlyA++;
+            continue;
+        }
+        const ChunkDigest & x = entry.second;
+        const ChunkDigest & y = other->second;
+        if(x.hits == y.hits && x.nearMisses == y.nearMisses && x.hash == y.hash) {
+            matching++;
+            continue;
+        }
+        differing++;
+        out << "differs, ";
+        printDigest(x, out);
+        out << " vs " << y.hits << " hits, " << y.nearMisses << " near misses, hash "
+            << std::hex << std::setw(16) << std::setfill('0') << y.hash << std::dec << std::setfill(' ') << std::endl;
+    }
+    for(const auto & entry : b) {
+        if(a.find(entry.first) == a.end()) {
+            onlyB++;
+        }
+    }
+
+    out << matching << " chunks match, " << differing << " differ, " << onlyA << " only in " << pathA << ", "
+        << onlyB << " only in " << pathB << "." << std::endl;
+    if(differing > 0) {
+        return 2;
+    }
+    // the chunks in both agree, but a run was cut short or searched another range.
+    return onlyA > 0 || onlyB > 0 ? 3 : 0;
+}
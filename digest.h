@@ -0,0 +1,88 @@
+/**
+ * @file digest.h
+ *
+ * A digest of each chunk of the search, so two runs (eg: on a new host, or with a new CRC backend) can be
+ * compared chunk by chunk in seconds rather than by diffing their results.
+ *
+ * A chunk's digest is its hit and near miss counts, and a 64 bit FNV-1a hash of its results in resultOrder,
+ * so it does not depend on the tile size or how the results were batched. Completed chunks are appended to a
+ * digest file (which doubles as a record of which chunks are done), a line per chunk:
+ *
+ *     family start_inc end_ex hits near_misses hash
+ *
+ * Runs are only comparable if they used the same chunk size and near miss distance.
+ */
+#ifndef CRC_SENTENCES_DIGEST_H
+#define CRC_SENTENCES_DIGEST_H
+
+#include "pipeline.h"
+#include "scheduler.h"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+/**
+ * What a chunk found, in brief.
+ */
+struct ChunkDigest
+{
+    WorkChunk chunk;
+    uint64_t hits = 0;
+    uint64_t nearMisses = 0;
+    uint64_t hash = 0;
+};
+
+/**
+ * Sits in front of a search thread's sink, keeping a copy of the results of the chunk being searched.
+ */
+class DigestingSink : public ResultSink
+{
+public:
+    explicit DigestingSink(ResultSink & next) : next(next) { }
+
+    void emit(ResultBatch && batch) override;
+
+    /**
+     * Digests the results since the last call, which are those of chunk.
+     * @param result What testSentences() counted for the chunk.
+     */
+    ChunkDigest finishChunk(const WorkChunk & chunk, const ChunkResult & result);
+
+private:
+    ResultSink & next;
+    ResultBatch results;
+};
+
+/**
+ * The digest file, appended to by every search thread.
+ */
+class DigestWriter
+{
+public:
+    explicit DigestWriter(const std::string & path);
+
+    bool isOpen() const { return file.is_open(); }
+
+    void write(const ChunkDigest & digest);
+
+    /**
+     * @return false if any line could not be written.
+     */
+    bool close();
+
+private:
+    std::mutex lock;
+    std::ofstream file;
+};
+
+/**
+ * Compares two digest files, writing the chunks that differ or are only in one of them.
+ * @return The exit code, 0 if they have the same chunks and every one matches, 2 if any chunk differs,
+ *         3 if none differ but some chunks are only in one file, 1 if a file could not be read.
+ */
+int compareDigestFiles(const std::string & pathA, const std::string & pathB, std::ostream & out);
+
+#endif //CRC_SENTENCES_DIGEST_H
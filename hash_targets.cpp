@@ -0,0 +1,543 @@
+/**
+ * @file hash_targets.cpp
+ *
+ * FNV-1a, MurmurHash3_x86_32, xxHash32, Adler-32, Fletcher-32 and SHA-256 of sentences, see hash_targets.h
+ */
+#include "hash_targets.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HASH_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+static const uint32_t fnvOffset = 0x811c9dc5;
+static const uint32_t fnvPrime = 16777619;
+
+static const uint32_t murmurC1 = 0xcc9e2d51;
+static const uint32_t murmurC2 = 0x1b873593;
+
+static const uint32_t xxPrime1 = 0x9e3779b1;
+static const uint32_t xxPrime2 = 0x85ebca77;
+static const uint32_t xxPrime3 = 0xc2b2ae3d;
+static const uint32_t xxPrime4 = 0x27d4eb2f;
+static const uint32_t xxPrime5 = 0x165667b1;
+
+static const uint32_t adlerModulus = 65521;
+static const uint32_t fletcherModulus = 65535;
+
+bool parseHashFunction(const std::string & name, HashFunction & function)
+{
+    if(name == "crc") {
+        function = HashFunction::CRC;
+    }
+    else if(name == "fnv1a") {
+        function = HashFunction::FNV1a;
+    }
+    else if(name == "murmur3") {
+        function = HashFunction::Murmur3;
+    }
+    else if(name == "xxhash32") {
+        function = HashFunction::XXHash32;
+    }
+    else if(name == "adler32") {
+        function = HashFunction::Adler32;
+    }
+    else if(name == "fletcher32") {
+        function = HashFunction::Fletcher32;
+    }
+    else if(name == "sha256") {
+        function = HashFunction::SHA256;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+const char * hashFunctionName(HashFunction function)
+{
+    switch(function) {
+        case HashFunction::FNV1a: return "fnv1a";
+        case HashFunction::Murmur3: return "murmur3";
+        case HashFunction::XXHash32: return "xxhash32";
+        case HashFunction::Adler32: return "adler32";
+        case HashFunction::Fletcher32: return "fletcher32";
+        case HashFunction::SHA256: return "sha256";
+        default: return "crc";
+    }
+}
+
+static inline uint32_t rotl(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t readWord(const uint8_t * p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint32_t murmurBlock(uint32_t h, uint32_t k)
+{
+    k *= murmurC1;
+    k = rotl(k, 15);
+    k *= murmurC2;
+    h ^= k;
+    h = rotl(h, 13);
+    return h * 5 + 0xe6546b64;
+}
+
+static inline uint32_t xxRound(uint32_t acc, uint32_t word)
+{
+    return rotl(acc + word * xxPrime2, 13) * xxPrime1;
+}
+
+/**
+ * Where the hash can be cached up to, for a message with the digits at digitOffset.
+ */
+static size_t cacheableLength(HashFunction function, size_t digitOffset, size_t length)
+{
+    switch(function) {
+        case HashFunction::FNV1a: return digitOffset;
+        case HashFunction::Murmur3: return digitOffset & ~(size_t) 3;
+        case HashFunction::XXHash32: return length >= 16 ? digitOffset & ~(size_t) 15 : 0;
+        default: return 0;
+    }
+}
+
+/**
+ * The state of the hash after the first upTo bytes (a cacheableLength) of a message.
+ */
+static void startHash(HashFunction function, const uint8_t * m, size_t upTo, size_t length, uint32_t * state)
+{
+    switch(function) {
+        case HashFunction::FNV1a:
+            state[0] = fnvOffset;
+            for(size_t p=0; p<upTo; p++) {
+                state[0] = (state[0] ^ m[p]) * fnvPrime;
+            }
+            break;
+        case HashFunction::Murmur3:
+            state[0] = 0;
+            for(size_t b=0; b<upTo; b+=4) {
+                state[0] = murmurBlock(state[0], readWord(m + b));
+            }
+            break;
+        case HashFunction::XXHash32:
+            if(length >= 16) {
+                state[0] = xxPrime1 + xxPrime2;
+                state[1] = xxPrime2;
+                state[2] = 0;
+                state[3] = 0 - xxPrime1;
+                for(size_t b=0; b<upTo; b+=16) {
+                    for(int a=0; a<4; a++) {
+                        state[a] = xxRound(state[a], readWord(m + b + 4 * a));
+                    }
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Hashes the rest of a message, from a state made by startHash.
+ */
+static uint32_t finishHash(HashFunction function, const uint32_t * state, const uint8_t * m, size_t from, size_t length)
+{
+    switch(function)
+    {
+        case HashFunction::FNV1a:
+        {
+            uint32_t h = state[0];
+            for(size_t p=from; p<length; p++) {
+                h = (h ^ m[p]) * fnvPrime;
+            }
+            return h;
+        }
+        case HashFunction::Murmur3:
+        {
+            uint32_t h = state[0];
+            size_t b = from;
+            for(; b+4<=length; b+=4) {
+                h = murmurBlock(h, readWord(m + b));
+            }
+            uint32_t k = 0;
+            for(size_t j=length-b; j>0; j--) {
+                k = (k << 8) | m[b + j - 1];
+            }
+            if(b < length) {
+                k *= murmurC1;
+                k = rotl(k, 15);
+                k *= murmurC2;
+                h ^= k;
+            }
+            h ^= (uint32_t) length;
+            h ^= h >> 16;
+            h *= 0x85ebca6b;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35;
+            h ^= h >> 16;
+            return h;
+        }
+        case HashFunction::XXHash32:
+        {
+            uint32_t h;
+            size_t b = from;
+            if(length >= 16) {
+                uint32_t acc[4] = {state[0], state[1], state[2], state[3]};
+                for(; b+16<=length; b+=16) {
+                    for(int a=0; a<4; a++) {
+                        acc[a] = xxRound(acc[a], readWord(m + b + 4 * a));
+                    }
+                }
+                h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+            }
+            else {
+                h = xxPrime5;
+            }
+            h += (uint32_t) length;
+            for(; b+4<=length; b+=4) {
+                h = rotl(h + readWord(m + b) * xxPrime3, 17) * xxPrime4;
+            }
+            for(; b<length; b++) {
+                h = rotl(h + m[b] * xxPrime5, 11) * xxPrime1;
+            }
+            h ^= h >> 15;
+            h *= xxPrime2;
+            h ^= h >> 13;
+            h *= xxPrime3;
+            h ^= h >> 16;
+            return h;
+        }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * The sums of Adler-32 / Fletcher-32 are made of what each byte adds to them, given its position.
+ * @return second sum << 32 | first sum, what the byte at position p of a length byte message adds (not reduced).
+ */
+static uint64_t sumTerms(HashFunction function, uint8_t byte, size_t p, size_t length)
+{
+    if(function == HashFunction::Adler32) {
+        return ((uint64_t)(length - p) * byte << 32) | byte;
+    }
+
+    // Fletcher-32, a byte is the low or high half of a word, words are summed.
+    size_t words = (length + 1) / 2;
+    uint64_t value = (uint64_t) byte << (8 * (p & 1));
+    return ((uint64_t)(words - p / 2) * value << 32) | value;
+}
+
+static uint64_t reduceSums(uint64_t sums, uint32_t modulus)
+{
+    return ((sums >> 32) % modulus) << 32 | ((sums & 0xffffffff) % modulus);
+}
+
+static uint32_t sumsToHash(uint64_t sums)
+{
+    return (uint32_t)((sums >> 32) << 16 | (sums & 0xffff));
+}
+
+static uint32_t calculateSums(HashFunction function, const std::string & text)
+{
+    uint32_t modulus = function == HashFunction::Adler32 ? adlerModulus : fletcherModulus;
+
+    // Adler-32 starts its first sum at 1, which adds 1 to the second sum for each byte.
+    uint64_t sums = function == HashFunction::Adler32 ? ((uint64_t) text.size() << 32) | 1 : 0;
+    for(size_t p=0; p<text.size(); p++) {
+        sums = reduceSums(sums + sumTerms(function, (uint8_t) text[p], p, text.size()), modulus);
+    }
+    return sumsToHash(sums);
+}
+
+uint32_t calculateHash(HashFunction function, const std::string & text)
+{
+    if(function == HashFunction::Adler32 || function == HashFunction::Fletcher32) {
+        return calculateSums(function, text);
+    }
+    if(function == HashFunction::SHA256) {
+        return calculateSHA256Prefix(text);
+    }
+
+    uint32_t state[4];
+    startHash(function, (const uint8_t *) text.data(), 0, text.size(), state);
+    return finishHash(function, state, (const uint8_t *) text.data(), 0, text.size());
+}
+
+HashTemplate::HashTemplate(HashFunction function, const SentenceTemplate & t)
+        : function(function), upperCase(t.upperCase), message(t.sentence(0)), digitOffset(t.prefix.size())
+{
+    cachedLength = cacheableLength(function, digitOffset, message.size());
+    startHash(function, (const uint8_t *) message.data(), cachedLength, message.size(), state);
+    if(function == HashFunction::Adler32 || function == HashFunction::Fletcher32) {
+        makeSumTables();
+    }
+    if(function == HashFunction::SHA256) {
+        sha256 = SHA256Template(message, digitOffset, upperCase);
+    }
+}
+
+void HashTemplate::makeSumTables()
+{
+    const size_t length = message.size();
+    modulus = function == HashFunction::Adler32 ? adlerModulus : fletcherModulus;
+
+    // everything but the digits
+    sumBase = function == HashFunction::Adler32 ? ((uint64_t) length << 32) | 1 : 0;
+    for(size_t p=0; p<length; p++) {
+        if(p < digitOffset || p >= digitOffset + crcStringLength) {
+            sumBase = reduceSums(sumBase + sumTerms(function, (uint8_t) message[p], p, length), modulus);
+        }
+    }
+
+    // the digits, a pair at a time
+    const char * hex = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+    sumTables.resize(crcStringLength / 2 * 256);
+    for(int pair=0; pair<crcStringLength/2; pair++) {
+        size_t p = digitOffset + 2 * pair;
+        for(int byte=0; byte<256; byte++) {
+            uint64_t sums = sumTerms(function, (uint8_t) hex[byte >> 4], p, length)
+                          + sumTerms(function, (uint8_t) hex[byte & 0xf], p + 1, length);
+            sumTables[pair * 256 + byte] = reduceSums(sums, modulus);
+        }
+    }
+}
+
+/**
+ * Adler-32 / Fletcher-32, four lookups and adds, then a reduction of each sum.
+ * The modulus is a template parameter so the reductions are multiplies rather than divides.
+ */
+template<uint32_t modulus>
+static void addSums(uint64_t base, const uint64_t * table, const uint32_t * values, uint32_t * hashes, size_t n)
+{
+    for(size_t k=0; k<n; k++) {
+        uint32_t v = values[k];
+        uint64_t sums = base + table[v >> 24] + table[256 + ((v >> 16) & 0xff)]
+                      + table[512 + ((v >> 8) & 0xff)] + table[768 + (v & 0xff)];
+        uint32_t first = (uint32_t) sums % modulus;
+        uint32_t second = (uint32_t)(sums >> 32) % modulus;
+        hashes[k] = second << 16 | first;
+    }
+}
+
+void HashTemplate::evaluateSums(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    if(modulus == adlerModulus) {
+        addSums<adlerModulus>(sumBase, sumTables.data(), values, hashes, n);
+    }
+    else {
+        addSums<fletcherModulus>(sumBase, sumTables.data(), values, hashes, n);
+    }
+}
+
+void HashTemplate::evaluate(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    if(!sumTables.empty()) {
+        evaluateSums(values, hashes, n);
+    }
+    else if(function == HashFunction::SHA256) {
+        sha256.evaluate(values, hashes, n);
+    }
+    else if(hashKernelsUseAVX2()) {
+        evaluateAVX2(values, hashes, n);
+    }
+    else {
+        evaluateScalar(values, hashes, n);
+    }
+}
+
+void HashTemplate::evaluateScalar(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    // a copy to write the digits of each value into.
+    uint8_t buffer[256];
+    std::string longBuffer;
+    uint8_t * m = buffer;
+    if(message.size() > sizeof(buffer)) {
+        longBuffer = message;
+        m = (uint8_t *) &longBuffer[0];
+    }
+    else {
+        std::memcpy(buffer, message.data(), message.size());
+    }
+
+    for(size_t k=0; k<n; k++) {
+        writeCRCString(values[k], upperCase, (char *) m + digitOffset);
+        hashes[k] = finishHash(function, state, m, cachedLength, message.size());
+    }
+}
+
+#ifdef HASH_KERNELS_AVX2
+
+bool hashKernelsUseAVX2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+/**
+ * The bytes of 8 sentences at once, a sentence per lane.
+ */
+struct LaneMessage
+{
+    const std::string & message;
+    size_t digitOffset;
+    __m256i digits[crcStringLength];  // character of each digit, in the low byte
+
+    __attribute__((target("avx2"))) inline __m256i byte(size_t p) const
+    {
+        if(p >= digitOffset && p < digitOffset + crcStringLength) {
+            return digits[p - digitOffset];
+        }
+        return _mm256_set1_epi32((uint8_t) message[p]);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i word(size_t p) const
+    {
+        // the whole word is the same in every lane if it does not overlap the digits.
+        if(p + 4 <= digitOffset || p >= digitOffset + crcStringLength) {
+            return _mm256_set1_epi32((int) readWord((const uint8_t *) message.data() + p));
+        }
+        __m256i w = byte(p);
+        for(int j=1; j<4; j++) {
+            w = _mm256_or_si256(w, _mm256_sll_epi32(byte(p + j), _mm_cvtsi32_si128(8 * j)));
+        }
+        return w;
+    }
+};
+
+template<int r>
+__attribute__((target("avx2"))) static inline __m256i rotlLanes(__m256i x)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(x, r), _mm256_srli_epi32(x, 32 - r));
+}
+
+__attribute__((target("avx2"))) static inline __m256i mul(__m256i x, uint32_t c)
+{
+    return _mm256_mullo_epi32(x, _mm256_set1_epi32((int) c));
+}
+
+__attribute__((target("avx2"))) static inline __m256i murmurBlockLanes(__m256i h, __m256i k)
+{
+    k = mul(k, murmurC1);
+    k = rotlLanes<15>(k);
+    k = mul(k, murmurC2);
+    h = _mm256_xor_si256(h, k);
+    h = rotlLanes<13>(h);
+    return _mm256_add_epi32(mul(h, 5), _mm256_set1_epi32((int) 0xe6546b64));
+}
+
+__attribute__((target("avx2"))) static inline __m256i xxRoundLanes(__m256i acc, __m256i word)
+{
+    return mul(rotlLanes<13>(_mm256_add_epi32(acc, mul(word, xxPrime2))), xxPrime1);
+}
+
+__attribute__((target("avx2"))) static inline __m256i shiftXor(__m256i h, int s)
+{
+    return _mm256_xor_si256(h, _mm256_srl_epi32(h, _mm_cvtsi32_si128(s)));
+}
+
+__attribute__((target("avx2")))
+void HashTemplate::evaluateAVX2(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    const size_t length = message.size();
+    LaneMessage lanes = {message, digitOffset, {}};
+
+    const __m256i fifteen = _mm256_set1_epi32(15);
+    const __m256i nine = _mm256_set1_epi32(9);
+    const __m256i zero = _mm256_set1_epi32('0');
+    const __m256i letterGap = _mm256_set1_epi32((upperCase ? 'A' : 'a') - '0' - 10);
+
+    size_t k = 0;
+    for(; k+8<=n; k+=8)
+    {
+        // the hex digits of each lane's value
+        __m256i v = _mm256_loadu_si256((const __m256i *)(values + k));
+        for(int d=0; d<crcStringLength; d++) {
+            __m256i nibble = _mm256_and_si256(_mm256_srl_epi32(v, _mm_cvtsi32_si128(4 * (crcStringLength - 1 - d))), fifteen);
+            __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi32(nibble, nine), letterGap);
+            lanes.digits[d] = _mm256_add_epi32(_mm256_add_epi32(nibble, zero), letter);
+        }
+
+        __m256i h;
+        if(function == HashFunction::FNV1a)
+        {
+            h = _mm256_set1_epi32((int) state[0]);
+            for(size_t p=cachedLength; p<length; p++) {
+                h = mul(_mm256_xor_si256(h, lanes.byte(p)), fnvPrime);
+            }
+        }
+        else if(function == HashFunction::Murmur3)
+        {
+            h = _mm256_set1_epi32((int) state[0]);
+            size_t b = cachedLength;
+            for(; b+4<=length; b+=4) {
+                h = murmurBlockLanes(h, lanes.word(b));
+            }
+            if(b < length) {
+                __m256i t = _mm256_setzero_si256();
+                for(size_t j=0; b+j<length; j++) {
+                    t = _mm256_or_si256(t, _mm256_sll_epi32(lanes.byte(b + j), _mm_cvtsi32_si128(8 * (int) j)));
+                }
+                t = mul(rotlLanes<15>(mul(t, murmurC1)), murmurC2);
+                h = _mm256_xor_si256(h, t);
+            }
+            h = _mm256_xor_si256(h, _mm256_set1_epi32((int) length));
+            h = mul(shiftXor(h, 16), 0x85ebca6b);
+            h = mul(shiftXor(h, 13), 0xc2b2ae35);
+            h = shiftXor(h, 16);
+        }
+        else
+        {
+            size_t b = cachedLength;
+            if(length >= 16) {
+                __m256i acc[4];
+                for(int a=0; a<4; a++) {
+                    acc[a] = _mm256_set1_epi32((int) state[a]);
+                }
+                for(; b+16<=length; b+=16) {
+                    for(int a=0; a<4; a++) {
+                        acc[a] = xxRoundLanes(acc[a], lanes.word(b + 4 * a));
+                    }
+                }
+                h = _mm256_add_epi32(_mm256_add_epi32(rotlLanes<1>(acc[0]), rotlLanes<7>(acc[1])),
+                                     _mm256_add_epi32(rotlLanes<12>(acc[2]), rotlLanes<18>(acc[3])));
+            }
+            else {
+                h = _mm256_set1_epi32((int) xxPrime5);
+            }
+            h = _mm256_add_epi32(h, _mm256_set1_epi32((int) length));
+            for(; b+4<=length; b+=4) {
+                h = mul(rotlLanes<17>(_mm256_add_epi32(h, mul(lanes.word(b), xxPrime3))), xxPrime4);
+            }
+            for(; b<length; b++) {
+                h = mul(rotlLanes<11>(_mm256_add_epi32(h, mul(lanes.byte(b), xxPrime5))), xxPrime1);
+            }
+            h = mul(shiftXor(h, 15), xxPrime2);
+            h = mul(shiftXor(h, 13), xxPrime3);
+            h = shiftXor(h, 16);
+        }
+        _mm256_storeu_si256((__m256i *)(hashes + k), h);
+    }
+
+    evaluateScalar(values + k, hashes + k, n - k);
+}
+
+#else
+
+bool hashKernelsUseAVX2()
+{
+    return false;
+}
+
+void HashTemplate::evaluateAVX2(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    evaluateScalar(values, hashes, n);
+}
+
+#endif
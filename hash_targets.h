@@ -0,0 +1,88 @@
+/**
+ * @file hash_targets.h
+ *
+ * Non-CRC 32 bit hashes the sentences can be searched against: FNV-1a, MurmurHash3_x86_32 and xxHash32
+ * (seed 0). These are not linear, so each sentence is hashed in full, apart from what can be cached per template:
+ *
+ *     FNV-1a     the state after the text before the digits
+ *     Murmur3    the state after the whole 4 byte blocks before the digits
+ *     xxHash32   the 4 accumulators after the whole 16 byte stripes before the digits
+ *
+ * Every sentence of a template is the same length with the digits in the same place, so on cpus with AVX2
+ * 8 sentences are hashed at once, a sentence per 32 bit lane.
+ *
+ * Adler-32 and Fletcher-32 (16 bit little endian words, sums from 0, odd lengths zero padded) are sums, each
+ * byte adds to the first sum, and its weight (how many sums follow it) times itself to the second. So the
+ * checksum of a template's sentences is the sums of the rest of the sentence, plus a table lookup per pair of
+ * digits, and one reduction. No hashing at all per candidate.
+ *
+ * SHA-256 is truncated to the first 32 bits of the digest, see sha256.h
+ */
+#ifndef CRC_SENTENCES_HASH_TARGETS_H
+#define CRC_SENTENCES_HASH_TARGETS_H
+
+#include "sentence.h"
+#include "sha256.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class HashFunction {CRC, FNV1a, Murmur3, XXHash32, Adler32, Fletcher32, SHA256};
+
+/**
+ * @param name crc, fnv1a, murmur3, xxhash32, adler32, fletcher32 or sha256
+ * @return false if the name is not known.
+ */
+bool parseHashFunction(const std::string & name, HashFunction & function);
+
+const char * hashFunctionName(HashFunction function);
+
+/**
+ * @return The hash of text, for any function but CRC (see calculateCRC).
+ */
+uint32_t calculateHash(HashFunction function, const std::string & text);
+
+/**
+ * @return true if the 8 lane kernels are used on this cpu.
+ */
+bool hashKernelsUseAVX2();
+
+/**
+ * A sentence template, with the hash state of the text before the digits cached.
+ */
+class HashTemplate
+{
+public:
+    HashTemplate(HashFunction function, const SentenceTemplate & t);
+
+    /**
+     * Hashes the sentence stating each value.
+     */
+    void evaluate(const uint32_t * values, uint32_t * hashes, size_t n) const;
+
+private:
+    void evaluateScalar(const uint32_t * values, uint32_t * hashes, size_t n) const;
+    void evaluateAVX2(const uint32_t * values, uint32_t * hashes, size_t n) const;
+    void evaluateSums(const uint32_t * values, uint32_t * hashes, size_t n) const;
+    void makeSumTables();
+
+    HashFunction function;
+    bool upperCase;
+    std::string message;   // the sentence, digits are written over
+    size_t digitOffset;    // where the digits are in message
+    size_t cachedLength;   // bytes of message covered by state
+    uint32_t state[4];
+
+    // Adler-32 / Fletcher-32, second sum << 32 | first sum, of the text around the digits
+    // and of each pair of digits (by the value of the byte of i they show).
+    uint64_t sumBase = 0;
+    std::vector<uint64_t> sumTables;
+    uint32_t modulus = 0;
+
+    // SHA-256, the midstate and padded blocks of the sentence.
+    SHA256Template sha256;
+};
+
+#endif //CRC_SENTENCES_HASH_TARGETS_H
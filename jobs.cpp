@@ -0,0 +1,246 @@
+/**
+ * @file jobs.cpp
+ *
+ * Several searches on one pool of workers, see jobs.h
+ */
+#include "jobs.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+// What a chunk is charged before any chunk of its job has completed.
+static const double firstChunkSeconds = 0.01;
+
+static bool parseNumber(const std::string & text, uint64_t & value)
+{
+    char * end = nullptr;
+    value = std::strtoull(text.c_str(), &end, 0);
+    return !text.empty() && *end == '\0';
+}
+
+/**
+ * A comma separated list of family numbers.
+ */
+static bool parseFamilies(const std::string & text, uint32_t & mask)
+{
+    mask = 0;
+    std::istringstream list(text);
+    std::string item;
+    while(std::getline(list, item, ',')) {
+        uint64_t family;
+        if(!parseNumber(item, family) || family >= numSentenceFamilies) {
+            return false;
+        }
+        mask |= 1u << family;
+    }
+    return mask != 0;
+}
+
+bool parseJobSpecs(std::istream & in, std::vector<JobSpec> & jobs, std::ostream & error)
+{
+    std::string line;
+    int lineNumber = 0;
+    while(std::getline(in, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+
+        JobSpec job;
+        bool any = false;
+        std::istringstream fields(line);
+        std::string field;
+        while(fields >> field)
+        {
+            any = true;
+            size_t equals = field.find('=');
+            std::string key = field.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+
+            bool ok = !value.empty();
+            uint64_t number = 0;
+            if(key == "name") {
+                job.name = value;
+            }
+            else if(key == "crc") {
+                job.hashFunction = HashFunction::CRC;
+                ok = parseCRCParameters(value, job.crcParameters, error);
+            }
+            else if(key == "hash") {
+                ok = parseHashFunction(value, job.hashFunction);
+            }
+            else if(key == "start") {
+                ok = parseNumber(value, number) && number <= 0xffffffff;
+                job.start = (uint32_t) number;
+            }
+            else if(key == "length") {
+                ok = parseNumber(value, number) && number > 0 && number <= 0x100000000ULL;
+                job.length = number;
+            }
+            else if(key == "families") {
+                ok = parseFamilies(value, job.familyMask);
+            }
+            else if(key == "weight") {
+                job.weight = std::atof(value.c_str());
+                ok = job.weight > 0;
+            }
+            else if(key == "output") {
+                job.outputPath = value;
+            }
+            else {
+                ok = false;
+            }
+
+            if(!ok) {
+                error << "Line " << lineNumber << ": bad job field " << field
+                      << " (expected name, crc, hash, start, length, families, weight or output)" << std::endl;
+                return false;
+            }
+        }
+
+        if(!any) {
+            continue;
+        }
+        if(job.name.empty()) {
+            error << "Line " << lineNumber << ": the job has no name" << std::endl;
+            return false;
+        }
+        if((uint64_t) job.start + job.length > 0x100000000ULL) {
+            error << "Line " << lineNumber << ": the range of " << job.name << " goes past 0xffffffff" << std::endl;
+            return false;
+        }
+        if(job.outputPath.empty()) {
+            job.outputPath = job.name + ".txt";
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+JobRunner::JobRunner(uint32_t chunkSize) : chunkSize(chunkSize) { }
+
+void JobRunner::addJob(const JobSpec & spec, const JobSearch & search, ResultSink & sink)
+{
+    std::unique_ptr<Job> job(new Job());
+    job->spec = spec;
+    job->search = search;
+    job->sink = &sink;
+    job->scheduler.reset(new FamilyScheduler(spec.start, spec.length, chunkSize, spec.familyMask));
+    jobs.push_back(std::move(job));
+}
+
+/**
+ * Takes a chunk from the job furthest behind its share.
+ * @return false once every job has handed out all of its chunks.
+ */
+bool JobRunner::next(JobChunk & chunk)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    while(true)
+    {
+        int best = -1;
+        for(size_t k=0; k<jobs.size(); k++) {
+            if(!jobs[k]->handedOut && (best < 0 || jobs[k]->virtualSeconds < jobs[best]->virtualSeconds)) {
+                best = (int) k;
+            }
+        }
+        if(best < 0) {
+            return false;
+        }
+
+        Job & job = *jobs[best];
+        if(!job.scheduler->next(chunk.chunk)) {
+            job.handedOut = true;
+            continue;
+        }
+
+        chunk.job = (size_t) best;
+        chunk.charged = job.chunks > 0 ? job.seconds / job.chunks : firstChunkSeconds;
+        job.virtualSeconds += chunk.charged / job.spec.weight;
+        job.inFlight++;
+        return true;
+    }
+}
+
+void JobRunner::complete(const JobChunk & chunk, const ChunkResult & result, double seconds, std::ostream & log)
+{
+    Job & job = *jobs[chunk.job];
+    job.scheduler->complete(chunk.chunk, result);
+
+    std::lock_guard<std::mutex> guard(lock);
+    job.virtualSeconds += (seconds - chunk.charged) / job.spec.weight;
+    job.seconds += seconds;
+    job.chunks++;
+    job.inFlight--;
+    job.candidates += result.candidates;
+    job.hits += result.hits;
+    job.nearMisses += result.nearMisses;
+
+    int per = job.scheduler->percentComplete();
+    if(per != job.percentComplete) {
+        job.percentComplete = per;
+        log << job.spec.name << ": " << per << "% complete." << std::endl;
+    }
+}
+
+void JobRunner::worker(int index, WorkerGate & gate, std::ostream & log)
+{
+    traceThreadName("worker " + std::to_string(index));
+
+    JobChunk chunk;
+    while(true)
+    {
+        gate.wait(index);
+        if(!next(chunk)) {
+            gate.finish(); // let any parked workers see there is nothing left.
+            break;
+        }
+
+        Job & job = *jobs[chunk.job];
+        TraceScope scope("chunk", "search");
+        scope.setArg("family", chunk.chunk.family);
+        scope.setArg("start", chunk.chunk.start_inc);
+        auto chunkStart = std::chrono::steady_clock::now();
+        ChunkResult result = job.search(chunk.chunk, job.sink);
+        complete(chunk, result, std::chrono::duration<double>(std::chrono::steady_clock::now() - chunkStart).count(),
+                 log);
+    }
+}
+
+void JobRunner::run(int numThreads, WorkerGate & gate, std::ostream & log)
+{
+    std::vector<std::thread> threads;
+    for(int i=0; i<numThreads; i++) {
+        threads.emplace_back(&JobRunner::worker, this, i, std::ref(gate), std::ref(log));
+    }
+    for(std::thread & t : threads) {
+        t.join();
+    }
+}
+
+void JobRunner::printSummary(std::ostream & out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    double totalSeconds = 0;
+    for(const std::unique_ptr<Job> & job : jobs) {
+        totalSeconds += job->seconds;
+    }
+
+    out << "job  weight  share  chunks  candidates  hits  near misses  output" << std::endl;
+    for(const std::unique_ptr<Job> & job : jobs)
+    {
+        double share = totalSeconds > 0 ? job->seconds * 100 / totalSeconds : 0;
+        out << job->spec.name
+            << "  " << job->spec.weight
+            << "  " << std::fixed << std::setprecision(1) << share << "%" << std::defaultfloat
+            << "  " << job->chunks
+            << "  " << job->candidates
+            << "  " << job->hits
+            << "  " << job->nearMisses
+            << "  " << job->spec.outputPath << std::endl;
+    }
+}
@@ -0,0 +1,121 @@
+/**
+ * @file jobs.h
+ *
+ * Runs several searches at once on one pool of worker threads, rather than a process (and a thread per cpu)
+ * per search. Jobs are read from a spec file, a line per job of space separated fields:
+ *
+ *     # name is required, the rest default to a full CRC-32 search written to <name>.txt
+ *     name=crc32c crc=crc32c weight=2
+ *     name=fnv hash=fnv1a start=0xa0000000 length=0x10000000 families=0,1,2,3 output=fnv-results.txt
+ *
+ * Workers share the cpu between the jobs that still have work in proportion to their weight (weighted fair
+ * share of worker time). Each job keeps a virtual time, the worker seconds it has used divided by its weight,
+ * and the next chunk goes to the job with the lowest. A chunk is charged the job's average chunk time when it is
+ * handed out, and corrected to its real time when it completes, so jobs with slower hashes are not favoured.
+ */
+#ifndef CRC_SENTENCES_JOBS_H
+#define CRC_SENTENCES_JOBS_H
+
+#include "concurrency.h"
+#include "crc_parameters.h"
+#include "hash_targets.h"
+#include "pipeline.h"
+#include "scheduler.h"
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * One search of a spec file.
+ */
+struct JobSpec
+{
+    std::string name;
+    HashFunction hashFunction = HashFunction::CRC;
+    CRCParameters crcParameters;                // crc=, see crc_parameters.h
+    uint32_t start = 0;
+    uint64_t length = 0x100000000ULL;
+    uint32_t familyMask = allSentenceFamilies;  // families=, the sentence families searched
+    double weight = 1;                          // share of the workers relative to other jobs
+    std::string outputPath;                     // output=, <name>.txt if not given
+};
+
+/**
+ * Reads a spec file.
+ * @return false (with the reason written to error) if a line is not understood.
+ */
+bool parseJobSpecs(std::istream & in, std::vector<JobSpec> & jobs, std::ostream & error);
+
+/**
+ * Searches a chunk of a job, sending what it finds to the sink.
+ */
+typedef std::function<ChunkResult(const WorkChunk &, ResultSink *)> JobSearch;
+
+/**
+ * Shares a pool of workers between jobs.
+ */
+class JobRunner
+{
+public:
+    explicit JobRunner(uint32_t chunkSize);
+
+    /**
+     * Adds a job, must be called before run().
+     */
+    void addJob(const JobSpec & spec, const JobSearch & search, ResultSink & sink);
+
+    /**
+     * Searches every job to the end on numThreads workers, parked workers wait at the gate.
+     * @param log Where the progress of each job is written.
+     */
+    void run(int numThreads, WorkerGate & gate, std::ostream & log);
+
+    /**
+     * Writes the totals and share of worker time of each job.
+     */
+    void printSummary(std::ostream & out);
+
+private:
+    struct Job
+    {
+        JobSpec spec;
+        JobSearch search;
+        ResultSink * sink;
+        std::unique_ptr<FamilyScheduler> scheduler;
+        bool handedOut = false;     // every chunk has been handed out
+        double virtualSeconds = 0;  // worker seconds charged / weight
+        double seconds = 0;         // worker seconds of completed chunks
+        uint64_t chunks = 0;        // completed
+        uint64_t inFlight = 0;
+        uint64_t candidates = 0;
+        uint64_t hits = 0;
+        uint64_t nearMisses = 0;
+        int percentComplete = -1;
+    };
+
+    /**
+     * A chunk of a job, and what it was charged when handed out.
+     */
+    struct JobChunk
+    {
+        size_t job;
+        WorkChunk chunk;
+        double charged;
+    };
+
+    bool next(JobChunk & chunk);
+    void complete(const JobChunk & chunk, const ChunkResult & result, double seconds, std::ostream & log);
+    void worker(int index, WorkerGate & gate, std::ostream & log);
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<Job>> jobs;
+    uint32_t chunkSize;
+};
+
+#endif //CRC_SENTENCES_JOBS_H
@@ -8,82 +8,390 @@
  */
 #define CRCPP_USE_CPP11
 #include "3rd_party/CRC.h"
+#include "async_writer.h"
+#include "benchmark.h"
+#include "columnar_store.h"
+#include "concurrency.h"
+#include "control.h"
+#include "crc_evaluator.h"
+#include "digest.h"
+#include "hash_targets.h"
+#include "jobs.h"
+#include "metrics.h"
+#include "ordered_output.h"
+#include "pipeline.h"
+#include "sampling.h"
+#include "scheduler.h"
+#include "search.h"
+#include "sentence.h"
+#include "solver.h"
+#include "trace.h"
+#include "verify.h"
 
 #include <iomanip>
 #include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <thread>
 #include <mutex>
 #include <algorithm>
 #include <vector>
 #include <chrono>
+#include <memory>
 
 #include <ctype.h>
 #include <cmath>
 #include <bitset>
+#include <csignal>
 
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 
-// 512 different strings for the same CRC
-const int maxSentenceOperations = 0b100000000;
-
 // The system will report a near miss if the crc is within +/- this error margin,
 static const int nearMissDistance = 25;
 
+// Leading bits of the hash that must equal the value stated for a hit, 32 for all of them. Fewer (down to 24)
+// makes the slower hashes worth searching, eg: sentences stating the first 24 bits of their own SHA-256.
+static const int hashMatchBits = 32;
+
+// Number of i values in a unit of work handed to a thread (per sentence family).
+static const uint32_t chunkSize = 1 << 20;
+
+// Order in which a chunk is worked through (see search.h).
+static const Partitioning partitioning = Partitioning::TemplateMajor;
+
+// Tile sizes tried at start up, the fastest is used (only applies to TemplateMajor).
+static const uint32_t tileSizeCandidates[] = {256, 1024, 4096, 16384, 65536};
+
+// Number of results gathered before they are passed to the emitter (candidates are hashed in batches of hashBatchSize).
+static const size_t emitBatchSize = 64;
+
+// Number of result batches that can be queued for output before the search threads have to wait.
+static const size_t emitQueueCapacity = 1024;
+
+// Where results are written, "" for the console. Files are written asynchronously (io_uring where available).
+static const std::string resultsPath = "";
+
+// Write results ordered by i (byte identical between runs) once the search is done, rather than as they are found.
+// They go to resultsPath, or results.txt if that is not set.
+static const bool orderedOutput = false;
+
+// Results a thread holds in memory before writing them to its run file, when orderedOutput is set.
+static const size_t runBufferRecords = 1 << 16;
+
+// Shared memory name to publish results under for other processes (see result_ring.h), "" to not publish them.
+static const std::string sharedRingName = "";
+static const uint32_t sharedRingCapacity = 1 << 16;
+
+// Also keep every hit and near miss in a compact columnar store at this path (see columnar_store.h), "" for none.
+static const std::string nearMissStorePath = "";
+
+// Near misses printed (not ordered output) are limited to this many bytes per second, by narrowing the distance
+// printed. All near misses are still counted per family, and a sample of each is printed at the end.
+static const bool sampleNearMisses = true;
+static const double nearMissBytesPerSecond = 64 * 1024;
+static const size_t nearMissSamplesPerFamily = 8;
+
+// Append a digest of each completed chunk to this path (see digest.h), "" for none. Compare the digest files of two
+// runs with --compare-digests.
+static const std::string digestPath = "";
+
+// Unix socket path on which the number of workers can be changed while searching (see control.h), "" for none.
+static const std::string controlPath = "";
+
+// Serve live metrics in Prometheus text format on a Unix socket path or localhost port (eg: "9464"), "" for none.
+static const std::string metricsAddress = "";
+
+// Record what each thread does and write it as a Chrome trace (see trace.h) at this path on exit, "" for none.
+static const std::string tracePath = "";
+
+// The i range and chunk sizes searched by --scaling-benchmark, at each thread count and placement.
+static const uint32_t benchmarkStart = 0xa0000000;
+static const uint32_t benchmarkLength = 1 << 18;
+static const std::vector<uint32_t> benchmarkChunkSizes = {1 << 12, 1 << 14, 1 << 16};
+
+// Compile each template's CRC evaluator to machine code (x86-64 only), rather than interpreting its tables.
+static const bool compileEvaluators = true;
+
+// Hash CRCs a batch of consecutive values at a time, looking up only the digits that changed since the last value
+// (about 1.4x the compiled evaluators, TemplateMajor only).
+static const bool cacheDigitPrefixes = true;
+
+// Try each miss with some of the letters of its value in the other case, eg: "00cB5f79", which states the same value
+// (CRC only, see CaseRepair). Finds about 6x the hits of the all lower and all upper case sentences alone.
+static const bool repairCase = true;
+
+// The search run by main() (jobs of --jobs have their own).
+SearchModel searchModel;
+
+// The solver daemon (--serve), stopped by SIGINT or SIGTERM.
+SolverServer * solverServer = nullptr;
+
 // percentage complete counter
 volatile int percentComplete = -1;
 
 // Forward declarations, doxygen is in the definition.
-std::string generateSentence(const int operation, const std::string & crcString);
-std::string getInfoString(long i, int operation, long hash);
-std::string createCRCString(int crcValue, bool upperCase);
-void testSentences(const uint32_t start_inc, const uint32_t end_ex, bool reportPercentComplete);
+void configureSearch(SearchModel & model);
+uint32_t tuneTileSize(const SearchModel & model);
+int serveSolver(const std::string & path);
+int runJobs(const std::string & specPath, const CpuLimits & cpuLimits, int numThreads);
+std::unique_ptr<ControlServer> startControl(WorkerGate & gate, int numThreads);
+void searchWorker(const SearchModel & model, FamilyScheduler & scheduler, WorkerGate & gate, ResultSink & sink,
+                  WorkerCounters & counters, DigestWriter * digests, int worker, uint32_t tileSize,
+                  bool reportPercentComplete);
 
 /**
  * Generates random sentences and dumps them to stdout.
  * Uses threading.
+ *
+ *     simpleTestCRC                       run the search
+ *     simpleTestCRC --store-stats <file>  yield statistics of a near miss store
+ *     simpleTestCRC --scaling-benchmark <csv file>  throughput at each thread count, chunk size and placement
+ *     simpleTestCRC --serve <socket path>  answer queries for sentences (see solver.h) until interrupted
+ *     simpleTestCRC --jobs <spec file>  run the searches listed in the file together (see jobs.h)
+ *     simpleTestCRC --verify <file>  check the sentences in a file (one per line) state their own CRC
+ *     simpleTestCRC --compare-digests <file> <file>  compare the chunk digests of two runs (see digest.h)
+ *
+ * Any of these can be preceded by --crc <name or parameters> to search another CRC (see crc_parameters.h),
+ * or --hash <fnv1a|murmur3|xxhash32|adler32|fletcher32|sha256> to search another hash (see hash_targets.h).
  */
-int main()
+int main(int argc, char * argv[])
 {
     // Enable thousands separators
     std::cout.imbue(std::locale(""));
+    configureSearch(searchModel);
+
+    // The CRC to search, CRC-32 unless given.
+    if(argc >= 3 && std::string(argv[1]) == "--crc") {
+        CRCParameters parameters;
+        if(!parseCRCParameters(argv[2], parameters, std::cerr)) {
+            return 1;
+        }
+        setCRCParameters(parameters);
+        argc -= 2;
+        argv += 2;
+    }
+    else if(argc >= 3 && std::string(argv[1]) == "--hash") {
+        if(!parseHashFunction(argv[2], searchModel.hashFunction)) {
+            std::cerr << "Unknown hash " << argv[2] << ", expected one of: crc fnv1a murmur3 xxhash32 adler32 fletcher32 sha256" << std::endl;
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    if(argc == 3 && std::string(argv[1]) == "--store-stats") {
+        return printStoreStats(argv[2]);
+    }
+    if(argc == 4 && std::string(argv[1]) == "--compare-digests") {
+        return compareDigestFiles(argv[2], argv[3], std::cout);
+    }
 
     // Print a synopsis.
     std::cout << "A tool to create \"autological sentences\" for testing/fun, ie: sentences that describe themselves"
               << std::endl;
     std::cout << "\tSee source code to configure or make changes." << std::endl << std::endl;
+    if(searchModel.hashFunction == HashFunction::CRC) {
+        printCRCParameters(getCRCParameters(), std::cout);
+        std::cout << "CRC of \"123456789\": " << createCRCString(calculateCRC("123456789"), false) << std::endl;
+    }
+    else {
+        // the sums (Adler-32, Fletcher-32) are table lookups, SHA-256 has its own kernels, the 8 lane kernels
+        // are for the others.
+        bool sums = searchModel.hashFunction == HashFunction::Adler32
+                    || searchModel.hashFunction == HashFunction::Fletcher32;
+        std::string kernel = hashKernelsUseAVX2() && !sums ? " (AVX2)" : "";
+        if(searchModel.hashFunction == HashFunction::SHA256) {
+            kernel = std::string(" (") + sha256KernelName(sha256Kernel()) + ")";
+        }
+        std::cout << "Hash " << hashFunctionName(searchModel.hashFunction) << kernel
+                  << ", of \"123456789\": "
+                  << createCRCString(calculateHash(searchModel.hashFunction, "123456789"), false) << std::endl;
+    }
 
-    // Detect cpu concurrency
-    int numThreads = std::thread::hardware_concurrency();
-    if(numThreads == 0) {
+    // Answer queries from other processes, rather than searching.
+    if(argc == 3 && std::string(argv[1]) == "--serve") {
+        return serveSolver(argv[2]);
+    }
+
+    // Detect cpu concurrency, honouring the affinity mask and any container cpu quota.
+    CpuLimits cpuLimits = detectCpuLimits();
+    int numThreads = cpuLimits.usableThreads();
+    if(cpuLimits.hardwareThreads == 0 && cpuLimits.affinityThreads == 0 && cpuLimits.cpuQuota == 0) {
         std::cerr << "Could not detect cpu cores properly, using 1 thread." << std::endl;
         numThreads = 1;
     }
     else {
-        std::cout << "Detected ability to use " << numThreads << " threads." << std::endl;
+        printCpuLimits(cpuLimits, std::cout);
         numThreads = std::max(numThreads-1, 1); // leave a thread spare if possible.
     }
 
+    // Measure how the search scales on this host, rather than searching.
+    if(argc == 3 && std::string(argv[1]) == "--scaling-benchmark") {
+        std::ofstream csv(argv[2]);
+        if(!csv) {
+            std::cerr << "Could not write " << argv[2] << std::endl;
+            return 1;
+        }
+        buildTemplates(searchModel, getCRCParameters(), &std::cout);
+        uint32_t tileSize = tuneTileSize(searchModel);
+        runScalingBenchmark(benchmarkStart, benchmarkLength, benchmarkChunkSizes, cpuLimits.usableThreads(),
+                            [=](const WorkChunk & chunk) {
+                                return testSentences(searchModel, chunk.start_inc, chunk.end_ex, chunk.family, tileSize, nullptr);
+                            }, csv, std::cout);
+        std::cout << "Results written to " << argv[2] << std::endl;
+        return 0;
+    }
+
+    // Check sentences found before, rather than searching. Exits with 2 if any are wrong.
+    if(argc == 3 && std::string(argv[1]) == "--verify") {
+        VerifyOptions options;
+        options.hashFunction = searchModel.hashFunction;
+        options.crcParameters = getCRCParameters();
+        options.matchBits = hashMatchBits;
+        options.threads = cpuLimits.usableThreads();
+        VerifyResult result;
+        if(!verifySentences(argv[2], options, result, std::cout)) {
+            std::cerr << "Could not read " << argv[2] << std::endl;
+            return 1;
+        }
+        std::cout << result.lines << " lines in " << (uint64_t)(result.seconds * 1000) << "ms ("
+                  << (uint64_t)(result.bytes / std::max(result.seconds, 1e-9) / 1e6) << " MB/s): "
+                  << result.valid << " valid, " << result.wrongHash << " wrong CRC, "
+                  << result.wrongLength << " wrong length, " << result.noValue << " with no CRC." << std::endl;
+        return (result.wrongHash || result.wrongLength || result.noValue) ? 2 : 0;
+    }
+
+    // Run the searches of a spec file together, rather than one search.
+    if(argc == 3 && std::string(argv[1]) == "--jobs") {
+        return runJobs(argv[2], cpuLimits, numThreads);
+    }
+
+    if(!tracePath.empty()) {
+        startTrace();
+        traceThreadName("main");
+    }
+
+    // Split the sentences into templates, and pick a tile size for this machine.
+    buildTemplates(searchModel, getCRCParameters(), &std::cout);
+    uint32_t tileSize = tuneTileSize(searchModel);
+
     // Search bounds
     uint32_t start = 0;
-    uint32_t length = 0xffffffff;
-    uint32_t bucketSize = length / numThreads;
+    uint64_t length = 1ULL << 32;
+
+    // Threads pull (family, i-block) chunks from here, favouring the more productive sentence families.
+    FamilyScheduler scheduler(start, length, chunkSize);
 
-    // Threads
+    // Threads, workers can be parked by the throttle monitor if the cpu quota is being exceeded.
     std::vector<std::thread> threads;
+    WorkerGate gate(numThreads);
+    ThrottleMonitor throttleMonitor(cpuLimits, gate, numThreads);
+    throttleMonitor.start();
+    std::unique_ptr<ControlServer> controlServer = startControl(gate, numThreads);
+
+    // Hits and near misses are formatted and written by the emitter's own thread, to the console or a file.
+    StreamOutput consoleOutput(std::cout);
+    std::unique_ptr<AsyncFileWriter> fileOutput;
+    if(!orderedOutput && !resultsPath.empty()) {
+        fileOutput.reset(new AsyncFileWriter(resultsPath));
+        std::cout << "Writing results to " << resultsPath
+                  << (fileOutput->usingIoUring() ? " (io_uring)." : " (pwrite).") << std::endl;
+    }
+    ResultEmitter emitter(fileOutput ? (TextOutput &) *fileOutput : consoleOutput, emitQueueCapacity);
+    emitter.start();
+
+    // the near misses going to the emitter are sampled to keep within the output budget.
+    std::unique_ptr<SampledNearMissSink> sampler;
+    if(sampleNearMisses && !orderedOutput) {
+        sampler.reset(new SampledNearMissSink(emitter, nearMissDistance, nearMissBytesPerSecond, nearMissSamplesPerFamily));
+    }
+
+    // or to a run file per thread, to be merged into one ordered results file at the end.
+    std::string orderedPath = resultsPath.empty() ? "results.txt" : resultsPath;
+    std::vector<std::unique_ptr<RunWriter>> runWriters;
+
+    // and optionally into shared memory, a ring per thread.
+    std::unique_ptr<ResultRingPublisher> ringPublisher;
+    std::vector<std::unique_ptr<ResultSink>> extraSinks;
+    if(!sharedRingName.empty()) {
+        ringPublisher.reset(new ResultRingPublisher(sharedRingName, numThreads, sharedRingCapacity));
+        if(ringPublisher->isOpen()) {
+            std::cout << "Publishing results to shared memory " << sharedRingName << std::endl;
+        }
+        else {
+            ringPublisher.reset();
+        }
+    }
+
+    // and optionally into a columnar store, shared by all threads.
+    std::unique_ptr<ColumnarStoreWriter> nearMissStore;
+    if(!nearMissStorePath.empty()) {
+        nearMissStore.reset(new ColumnarStoreWriter(nearMissStorePath));
+        if(!nearMissStore->isOpen()) {
+            nearMissStore.reset();
+        }
+    }
+
+    // and a digest of each chunk.
+    std::unique_ptr<DigestWriter> digestWriter;
+    if(!digestPath.empty()) {
+        digestWriter.reset(new DigestWriter(digestPath));
+        if(digestWriter->isOpen()) {
+            std::cout << "Writing chunk digests to " << digestPath << std::endl;
+        }
+        else {
+            digestWriter.reset();
+        }
+    }
+
+    // Live metrics, from counters kept by each worker.
+    std::vector<std::unique_ptr<WorkerCounters>> workerCounters;
+    for(int i=0; i<numThreads; i++) {
+        workerCounters.emplace_back(new WorkerCounters());
+    }
+    std::unique_ptr<MetricsServer> metricsServer;
+    if(!metricsAddress.empty()) {
+        metricsServer.reset(new MetricsServer(metricsAddress, workerCounters));
+        metricsServer->addGauge("crc_emit_queue_depth", "Result batches waiting to be written.",
+                                [&]{ return (double) emitter.queueDepth(); });
+        metricsServer->addGauge("crc_active_workers", "Workers not parked.", [&]{ return (double) gate.getActive(); });
+        metricsServer->addGauge("crc_percent_complete", "Progress of the search.",
+                                [&]{ return (double) scheduler.percentComplete(); });
+        if(metricsServer->start()) {
+            std::cout << "Serving metrics on " << metricsAddress << std::endl;
+        }
+    }
 
-    // Launch a separate thread for each part of the range being investigated
+    // Launch the worker threads
     for(int i=0; i<numThreads; i++)
     {
-        uint32_t tStart = start + (i * bucketSize);
-        uint32_t tEnd = std::min(tStart+bucketSize, start+length);
-
         // this first thread launched is going to give a percent complete feedback to the console.
         bool isReporterThread = i==0;
-        
+
+        // where this thread's results go
+        std::vector<ResultSink *> sinks = {sampler ? (ResultSink *) sampler.get() : &emitter};
+        if(orderedOutput) {
+            runWriters.emplace_back(new RunWriter(orderedPath + ".run" + std::to_string(i), runBufferRecords));
+            sinks[0] = runWriters.back().get();
+        }
+        if(ringPublisher) {
+            extraSinks.emplace_back(new ResultRingSink(*ringPublisher, i));
+            sinks.push_back(extraSinks.back().get());
+        }
+        if(nearMissStore) {
+            sinks.push_back(nearMissStore.get());
+        }
+
+        ResultSink * sink = sinks[0];
+        if(sinks.size() > 1) {
+            extraSinks.emplace_back(new FanOutSink(sinks));
+            sink = extraSinks.back().get();
+        }
+
         // start the thread
-        threads.emplace_back(testSentences, tStart, tEnd, isReporterThread);
+        threads.emplace_back(searchWorker, std::cref(searchModel), std::ref(scheduler), std::ref(gate), std::ref(*sink),
+                             std::ref(*workerCounters[i]), digestWriter.get(), i, tileSize, isReporterThread);
     }
 
     // join all threads
@@ -92,211 +400,311 @@ int main()
             t.join();
         }
     }
-
-    // done.
-    return 0;
-}
-
-
-
-/**
- * Generates a sentence.
- * @param operation A number controlling which type of sentance to create (>= 0 and < maxSentenceOperations)
- * @param crcString A string representing a CRC.
- * @return
- */
-std::string generateSentence(const int operation, const std::string & crcString)
-{
-    // parse opCode
-    int basicText = operation & 0b11;
-    bool capitalFirstLetter =  (operation & 0b100) != 0;
-    bool fullStop =  (operation & 0b1000) != 0;
-    bool col =  (operation & 0b10000) != 0;
-    int openingPhrase = (operation & 0b1100000) >> 5;
-    bool appendLength = (operation & 0b10000000) != 0 ;
-
-    // output stream
-    std::ostringstream out;
-
-    // Start sentance.
-    switch(openingPhrase) {
-        case 0:
-            // no opening
-            break;
-        case 1:
-            out << (capitalFirstLetter ? "B" : "b");
-            out << "elieve it or not, ";
-            capitalFirstLetter = false;
-            break;
-        case 2:
-            out << (capitalFirstLetter ? "U" : "u");
-            out << "seful for testing, ";
-            capitalFirstLetter = false;
-            break;
-        case 3:
-            out << (capitalFirstLetter ? "H" : "h");
-            out << "andily, ";
-            capitalFirstLetter = false;
-            break;
+    throttleMonitor.stop();
+    if(controlServer) {
+        controlServer->stop();
     }
-
-    // Sentence body
-    switch(basicText) {
-        case 0:
-            out << (capitalFirstLetter ? "T" : "t");
-            out << "his text has a CRC of";
-            out << (col ? ": " : " ");
-            out << crcString;
-            break;
-        case 1:
-            out << (capitalFirstLetter ? "T" : "t");
-            out << "his string has a CRC of";
-            out << (col ? ": " : " ");
-            out << crcString;
-            break;
-        case 2:
-            out << (capitalFirstLetter ? "T" : "t");
-            out << "his has a CRC of";
-            out << (col ? ": " : " ");
-            out << crcString;
-            break;
-        case 3:
-            //nb: not using lower case 'i' for self
-            out << (capitalFirstLetter ? "I " : "I happen to ");
-            out << "have a CRC value of";
-            out << (col ? ": " : " ");
-            out << crcString;
-            break;
+    if(metricsServer) {
+        metricsServer->stop();
+    }
+    emitter.finish();
+    if(ringPublisher) {
+        ringPublisher->finish();
+    }
+    if(fileOutput && !fileOutput->close()) {
+        std::cerr << "Could not write all results to " << resultsPath << std::endl;
+    }
+    if(nearMissStore && !nearMissStore->close()) {
+        std::cerr << "Could not write all results to " << nearMissStorePath << std::endl;
+    }
+    if(digestWriter && !digestWriter->close()) {
+        std::cerr << "Could not write all digests to " << digestPath << std::endl;
     }
 
-    // Append a length string
-    if(appendLength) {
-        out << " and a length of ";
-
-        // calc string length including the fullstop, that may follow
-        int strLen = out.str().length() + (fullStop ? 1 : 0);
-
-        // calc string length including the number used to store the string length.
-        int charsToStoreLen =  (int) log10((double) strLen) + 1;
-        strLen += charsToStoreLen;
+    int exitCode = 0;
 
-        // and then handle the longer strLen, incrementing charsToStoreLen
-        int newCharsToStoreLen =  (int) log10((double) strLen) + 1;
-        if(newCharsToStoreLen > charsToStoreLen) {
-            strLen++;
+    // merge the sorted runs of each thread
+    if(orderedOutput) {
+        std::vector<RunWriter *> writers;
+        for(auto & writer : runWriters) {
+            writer->finish();
+            writers.push_back(writer.get());
+        }
+        long long count = mergeRuns(writers, orderedPath);
+        if(count < 0) {
+            std::cerr << "Could not write all results to " << orderedPath << std::endl;
+            exitCode = 1;
         }
+        else {
+            std::cout << count << " results written to " << orderedPath << std::endl;
+        }
+    }
 
-        // Done.
-        out << std::dec << strLen;
+    if(!tracePath.empty()) {
+        if(writeTrace(tracePath)) {
+            std::cout << "Trace written to " << tracePath << std::endl;
+        }
+        else {
+            std::cerr << "Could not write " << tracePath << std::endl;
+        }
     }
 
-    // Add a fullstop
-    if(fullStop) {
-        out << ".";
+    // yield per family
+    scheduler.printSummary(std::cout);
+    if(sampler) {
+        sampler->printSummary(std::cout);
     }
 
-    // Done.
-    return out.str();
+    // done.
+    return exitCode;
 }
 
+
+
 /**
- * Generates and tests sentences for a given CRC value range.
- * @param start_inc Start index (inclusive)
- * @param end_ex End index (exclusive)
- * @param reportPercentComplete True if function should report its percent complete,
+ * Runs chunks from the scheduler until there are none left.
+ * @param model What is searched.
+ * @param scheduler Source of work, shared by all threads.
+ * @param gate Parks this thread when fewer workers should be running.
+ * @param sink Output stage for hits and near misses.
+ * @param digests Where the digest of each chunk is written, or nullptr.
+ * @param worker Index of this worker.
+ * @param tileSize Number of i values tested per template before moving on to the next template.
+ * @param reportPercentComplete True if function should report the percent complete (of the whole search),
  */
-void testSentences(const uint32_t start_inc, const uint32_t end_ex, bool reportPercentComplete)
+void searchWorker(const SearchModel & model, FamilyScheduler & scheduler, WorkerGate & gate, ResultSink & sink,
+                  WorkerCounters & counters, DigestWriter * digests, int worker, uint32_t tileSize,
+                  bool reportPercentComplete)
 {
     // get the start time
     auto startTime = std::chrono::high_resolution_clock::now();
+    long numChunks = 0;
+    uint64_t numCandidates = 0;
+
+    traceThreadName("worker " + std::to_string(worker));
 
-    // loop through the integer range assigned to this thread
-    for(uint32_t i=start_inc; i<end_ex; i++)
+    // a copy of each chunk's results is kept to digest it, before any near misses are sampled away.
+    DigestingSink digestingSink(sink);
+    ResultSink & chunkSink = digests ? (ResultSink &) digestingSink : sink;
+
+    WorkChunk chunk;
+    while(true)
     {
+        // wait while parked, then get some work
+        gate.wait(worker);
+        if(!scheduler.next(chunk)) {
+            gate.finish(); // let any parked workers see there is nothing left.
+            break;
+        }
+
+        TraceScope scope("chunk", "search");
+        scope.setArg("family", chunk.family);
+        scope.setArg("start", chunk.start_inc);
+        auto chunkStart = std::chrono::steady_clock::now();
+        ChunkResult result = testSentences(model, chunk.start_inc, chunk.end_ex, chunk.family, tileSize, &chunkSink);
+        if(digests) {
+            digests->write(digestingSink.finishChunk(chunk, result));
+        }
+        scheduler.complete(chunk, result);
+        counters.addChunk(result, std::chrono::duration<double>(std::chrono::steady_clock::now() - chunkStart).count());
+        numChunks++;
+        numCandidates += result.candidates;
+
         // report percentage complete
-        if(reportPercentComplete && (i % 0xff) == 0) {
-            int per = (int)((((double) i-start_inc) / (double)(end_ex - start_inc)) * 100.0);
+        if(reportPercentComplete) {
+            int per = scheduler.percentComplete();
             if(per != percentComplete) {
                 percentComplete = per;
                 std::cout << per << "% complete." <<std::endl;
             }
         }
-
-        // loop uppercase / lowercase
-        for(int c=0; c<2; c++)
-        {
-            // create the crc string
-            std::string crcString = createCRCString(i, c == 1);
-
-            // loop through different sentance types
-            for (int operation = 0; operation < maxSentenceOperations; operation++)
-            {
-                // create a sentence and calculate its cCRC
-                std::string sentence = generateSentence(operation, crcString);
-                std::uint32_t crc = CRC::Calculate(sentence.c_str(), sentence.length(), CRC::CRC_32());
-
-                // Check against actual crc.
-                if (crc == i) {
-                    std::cout << "--------------------------------------------" << std::endl;
-                    std::cout << "HIT: " << getInfoString(i, operation, crc) << std::endl;
-                    std::cout << sentence << std::endl;
-                    std::cout << "--------------------------------------------" << std::endl;
-                }
-                else if (std::abs((long) crc - (long) i) < (nearMissDistance)) {
-                    // We report near misses (within 100), because this allows us estimate likelihood of a hit over a given time.
-                    std::cout << "NEAR MISS "<< getInfoString(i, operation, crc) << ": "<< sentence << std::endl;
-                }
-            }
-
-            // exit loop early, in the event there are no letters (changing capitalisation has no effect)
-            int numLetters = (int)std::count_if(crcString.begin(), crcString.end(), [](char c){return isalpha(c);});
-            if (numLetters == 0) {
-                break;
-            }
-        } // end for c
-
-    } // end for i
+    }
 
     // report duration
     auto finishTime = std::chrono::high_resolution_clock::now();
     milliseconds diff = duration_cast<milliseconds>(finishTime - startTime);
-    std::cout << "done: " << std::dec << start_inc << " to " << end_ex
-              << " in " << diff.count() << "ms" << std::endl;
+    // the hash rate of this thread, ie: of the core it ran on.
+    double rate = diff.count() > 0 ? numCandidates * 1000.0 / diff.count() : 0;
+    std::cout << "done: " << std::dec << numChunks << " chunks"
+              << " in " << diff.count() << "ms, " << (uint64_t) rate << " hashes/s" << std::endl;
+}
+
+/**
+ * Starts accepting changes to the number of workers on controlPath, if it is set.
+ * @return The server, or nullptr if there is none.
+ */
+std::unique_ptr<ControlServer> startControl(WorkerGate & gate, int numThreads)
+{
+    if(controlPath.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<ControlServer> server(new ControlServer(controlPath, gate, numThreads));
+    if(!server->start()) {
+        return nullptr;
+    }
+    std::cout << "Accepting worker changes on " << controlPath << std::endl;
+    return server;
 }
 
 /**
- * Turns loop params in testCRCThread, into useful debug text.
+ * Applies the settings above to a model.
  */
-std::string getInfoString(long i, int operation, long hash)
+void configureSearch(SearchModel & model)
 {
-    std::bitset<9> opBitset(operation);
+    model.nearMissDistance = nearMissDistance;
+    model.matchBits = hashMatchBits;
+    model.partitioning = partitioning;
+    model.emitBatchSize = emitBatchSize;
+    model.compileEvaluators = compileEvaluators;
+    model.cacheDigitPrefixes = cacheDigitPrefixes;
+    model.repairCase = repairCase;
+}
+
+/**
+ * Runs the solver daemon until SIGINT or SIGTERM, the autological sentences of the CRC being searched are
+ * worked out before it starts listening.
+ * @return The exit code.
+ */
+int serveSolver(const std::string & path)
+{
+    if(searchModel.hashFunction != HashFunction::CRC) {
+        std::cerr << "The solver only answers CRC queries." << std::endl;
+        return 1;
+    }
+
+    CRCSolver solver;
+    auto startTime = std::chrono::steady_clock::now();
+    size_t hits = solver.warm(getCRCParameters());
+    auto finishTime = std::chrono::steady_clock::now();
+    std::cout << hits << " autological sentences found in "
+              << duration_cast<milliseconds>(finishTime - startTime).count() << "ms." << std::endl;
 
-    std::ostringstream out;
-    out << "(i=" << i << ", op=" << opBitset << ", dist=" << std::dec << (hash - i) << ")";
-    return out.str();
+    SolverServer server(path, solver, getCRCParameters());
+    if(!server.open()) {
+        return 1;
+    }
+    solverServer = &server;
+    std::signal(SIGINT, [](int) { solverServer->stop(); });
+    std::signal(SIGTERM, [](int) { solverServer->stop(); });
+
+    std::cout << "Answering queries on " << path << std::endl;
+    server.run();
+    solverServer = nullptr;
+    return 0;
 }
 
 /**
- * Gets the string representation of a CRC string.
- *
- * @return 8 character, 0 padded hex string.
+ * Runs the searches of a spec file on one pool of workers, each writing its results to its own file.
+ * @return The exit code.
  */
-std::string createCRCString(int crcValue, bool upperCase)
+int runJobs(const std::string & specPath, const CpuLimits & cpuLimits, int numThreads)
 {
-    std::ostringstream out;
-    out << std::setw(8)       // set width to 8 chars
-        << std::setfill('0')  // pad with 0's
-        << std::hex           // convert to hex
-        << crcValue;
-    std::string crcString = out.str();
+    std::ifstream spec(specPath);
+    std::vector<JobSpec> specs;
+    if(!spec) {
+        std::cerr << "Could not read " << specPath << std::endl;
+        return 1;
+    }
+    if(!parseJobSpecs(spec, specs, std::cerr)) {
+        return 1;
+    }
+    if(specs.empty()) {
+        std::cerr << "No jobs in " << specPath << std::endl;
+        return 1;
+    }
+
+    // what each job searches, and where its results go.
+    std::vector<std::unique_ptr<SearchModel>> models;
+    std::vector<uint32_t> tileSizes;
+    std::vector<std::unique_ptr<AsyncFileWriter>> files;
+    std::vector<std::unique_ptr<ResultEmitter>> emitters;
+    for(const JobSpec & job : specs)
+    {
+        std::cout << "Job " << job.name << ": ";
+        if(job.hashFunction == HashFunction::CRC) {
+            printCRCParameters(job.crcParameters, std::cout);
+        }
+        else {
+            std::cout << "hash " << hashFunctionName(job.hashFunction) << std::endl;
+        }
+
+        models.emplace_back(new SearchModel());
+        configureSearch(*models.back());
+        models.back()->hashFunction = job.hashFunction;
+        buildTemplates(*models.back(), job.crcParameters, &std::cout);
+
+        // hashes differ in cost, so each job gets the tile size that suits its own.
+        tileSizes.push_back(tuneTileSize(*models.back()));
+
+        files.emplace_back(new AsyncFileWriter(job.outputPath));
+        if(!files.back()->isOpen()) {
+            std::cerr << "Could not write " << job.outputPath << std::endl;
+            return 1;
+        }
+        emitters.emplace_back(new ResultEmitter(*files.back(), emitQueueCapacity));
+        emitters.back()->start();
+    }
 
-    // case conversion is done in place.
-    if(upperCase) {
-        for (auto & letter: crcString) letter = toupper(letter);
+    JobRunner runner(chunkSize);
+    for(size_t k=0; k<specs.size(); k++) {
+        const SearchModel & model = *models[k];
+        uint32_t tileSize = tileSizes[k];
+        runner.addJob(specs[k], [&model, tileSize](const WorkChunk & chunk, ResultSink * sink) {
+            return testSentences(model, chunk.start_inc, chunk.end_ex, chunk.family, tileSize, sink);
+        }, *emitters[k]);
+    }
+
+    WorkerGate gate(numThreads);
+    ThrottleMonitor throttleMonitor(cpuLimits, gate, numThreads);
+    throttleMonitor.start();
+    std::unique_ptr<ControlServer> controlServer = startControl(gate, numThreads);
+    runner.run(numThreads, gate, std::cout);
+    throttleMonitor.stop();
+    if(controlServer) {
+        controlServer->stop();
+    }
+
+    for(size_t k=0; k<specs.size(); k++) {
+        emitters[k]->finish();
+        if(!files[k]->close()) {
+            std::cerr << "Could not write all results to " << specs[k].outputPath << std::endl;
+        }
     }
 
-    return crcString;
+    runner.printSummary(std::cout);
+    return 0;
 }
 
+/**
+ * Times a small part of the search with each of tileSizeCandidates.
+ * @return The fastest tile size.
+ */
+uint32_t tuneTileSize(const SearchModel & model)
+{
+    if(partitioning != Partitioning::TemplateMajor) {
+        return 1;
+    }
+
+    // a span of i values that has letters in the CRC string, so upper case templates get tested.
+    const uint32_t benchStart = 0xa0000000;
+    const uint32_t benchLength = 1 << 16;
 
+    uint32_t best = tileSizeCandidates[0];
+    long bestTime = -1;
+    for(uint32_t tileSize : tileSizeCandidates)
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        testSentences(model, benchStart, benchStart + benchLength, 0, tileSize, nullptr);
+        auto finishTime = std::chrono::high_resolution_clock::now();
+
+        long diff = std::chrono::duration_cast<std::chrono::microseconds>(finishTime - startTime).count();
+        std::cout << "tile size " << tileSize << ": " << diff << "us" << std::endl;
+        if(bestTime < 0 || diff < bestTime) {
+            bestTime = diff;
+            best = tileSize;
+        }
+    }
 
+    std::cout << "Using a tile size of " << best << "." << std::endl;
+    return best;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file metrics.cpp
+ *
+ * Live metrics, see metrics.h
+ */
+#include "metrics.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// How often the candidates per second are worked out.
+static const std::chrono::seconds rateInterval(1);
+
+// How long the server waits for a request before giving up on the connection.
+static const int requestTimeoutMs = 1000;
+
+/**
+ * Adds to a counter only this thread writes, so no locked read-modify-write is needed.
+ */
+static void bump(std::atomic<uint64_t> & counter, uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+WorkerCounters::WorkerCounters()
+        : candidates(0), hits(0), nearMisses(0), chunks(0), latencyMicros(0)
+{
+    for(std::atomic<uint64_t> & bucket : latencyBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void WorkerCounters::addChunk(const ChunkResult & result, double seconds)
+{
+    bump(candidates, result.candidates);
+    bump(hits, result.hits);
+    bump(nearMisses, result.nearMisses);
+    bump(chunks, 1);
+    bump(latencyMicros, (uint64_t)(seconds * 1e6));
+
+    int bucket = 0;
+    while(bucket < numLatencyBuckets - 1 && seconds > chunkLatencyBounds[bucket]) {
+        bucket++;
+    }
+    bump(latencyBuckets[bucket], 1);
+}
+
+MetricsServer::MetricsServer(const std::string & address, const std::vector<std::unique_ptr<WorkerCounters>> & workers)
+        : address(address), workers(workers), stopRequested(false),
+          lastCandidates(workers.size(), 0), rates(workers.size(), 0)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+void MetricsServer::addGauge(const std::string & name, const std::string & help, std::function<double()> value)
+{
+    gauges.push_back({name, help, value});
+}
+
+bool MetricsServer::start()
+{
+    if(!address.empty() && address[0] == '/') {
+        sockaddr_un local = {};
+        local.sun_family = AF_UNIX;
+        if(address.size() >= sizeof(local.sun_path)) {
+            std::cerr << "Metrics socket path too long: " << address << std::endl;
+            return false;
+        }
+        std::strcpy(local.sun_path, address.c_str());
+        unlink(address.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(listenFd >= 0 && bind(listenFd, (sockaddr *) &local, sizeof(local)) != 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+    }
+    else {
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons((uint16_t) std::atoi(address.c_str()));
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if(listenFd >= 0) {
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if(bind(listenFd, (sockaddr *) &local, sizeof(local)) != 0) {
+                close(listenFd);
+                listenFd = -1;
+            }
+        }
+    }
+
+    if(listenFd < 0 || listen(listenFd, 8) != 0) {
+        std::cerr << "Could not serve metrics on " << address << ": " << std::strerror(errno) << std::endl;
+        if(listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        return false;
+    }
+
+    lastRateTime = std::chrono::steady_clock::now();
+    thread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    stopRequested = true;
+    if(thread.joinable()) {
+        thread.join();
+    }
+    if(listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        if(address[0] == '/') {
+            unlink(address.c_str());
+        }
+    }
+}
+
+void MetricsServer::run()
+{
+    while(!stopRequested)
+    {
+        updateRates();
+
+        // wake up now and then to update the rates and see if we should stop.
+        pollfd listening = {listenFd, POLLIN, 0};
+        if(poll(&listening, 1, 250) <= 0) {
+            continue;
+        }
+        int connection = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(connection < 0) {
+            continue;
+        }
+
+        // any request gets the metrics, wait for the request so the client does not see the connection reset.
+        pollfd request = {connection, POLLIN, 0};
+        char buffer[1024];
+        if(poll(&request, 1, requestTimeoutMs) > 0 && recv(connection, buffer, sizeof(buffer), 0) > 0) {
+            std::string body = render();
+            std::string response = "HTTP/1.0 200 OK\r\n"
+                                   "Content-Type: text/plain; version=0.0.4\r\n"
+                                   "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                                   "Connection: close\r\n\r\n" + body;
+            size_t sent = 0;
+            while(sent < response.size()) {
+                ssize_t n = send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if(n <= 0) {
+                    break;
+                }
+                sent += (size_t) n;
+            }
+        }
+        close(connection);
+    }
+}
+
+/**
+ * Works out the candidates per second of each worker, once every rate interval.
+ */
+void MetricsServer::updateRates()
+{
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - lastRateTime).count();
+    if(elapsed < std::chrono::duration<double>(rateInterval).count()) {
+        return;
+    }
+    for(size_t k=0; k<workers.size(); k++) {
+        uint64_t candidates = workers[k]->candidates.load(std::memory_order_relaxed);
+        rates[k] = (double)(candidates - lastCandidates[k]) / elapsed;
+        lastCandidates[k] = candidates;
+    }
+    lastRateTime = now;
+}
+
+/**
+ * A counter per worker, labelled with the worker number.
+ */
+static void renderCounter(std::ostream & out, const char * name, const char * help,
+                          const std::vector<std::unique_ptr<WorkerCounters>> & workers,
+                          std::atomic<uint64_t> WorkerCounters::* counter)
+{
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+    for(size_t k=0; k<workers.size(); k++) {
+        out << name << "{worker=\"" << k << "\"} " << ((*workers[k]).*counter).load(std::memory_order_relaxed) << "\n";
+    }
+}
+
+std::string MetricsServer::render()
+{
+    // prometheus wants plain numbers, no thousands separators.
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+
+    renderCounter(out, "crc_candidates_total", "Sentences tested.", workers, &WorkerCounters::candidates);
+    renderCounter(out, "crc_hits_total", "Sentences matching their CRC.", workers, &WorkerCounters::hits);
+    renderCounter(out, "crc_near_misses_total", "Sentences close to their CRC.", workers, &WorkerCounters::nearMisses);
+    renderCounter(out, "crc_chunks_total", "Chunks searched.", workers, &WorkerCounters::chunks);
+
+    out << "# HELP crc_candidates_per_second Sentences tested per second, over the last second.\n"
+        << "# TYPE crc_candidates_per_second gauge\n";
+    for(size_t k=0; k<workers.size(); k++) {
+        out << "crc_candidates_per_second{worker=\"" << k << "\"} " << rates[k] << "\n";
+    }
+
+    out << "# HELP crc_chunk_seconds Time to search a chunk.\n# TYPE crc_chunk_seconds histogram\n";
+    for(size_t k=0; k<workers.size(); k++)
+    {
+        const WorkerCounters & w = *workers[k];
+        uint64_t cumulative = 0;
+        for(int b=0; b<numLatencyBuckets; b++) {
+            cumulative += w.latencyBuckets[b].load(std::memory_order_relaxed);
+            out << "crc_chunk_seconds_bucket{worker=\"" << k << "\",le=\"";
+            if(b < numLatencyBuckets - 1) {
+                out << chunkLatencyBounds[b];
+            }
+            else {
+                out << "+Inf";
+            }
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "crc_chunk_seconds_sum{worker=\"" << k << "\"} "
+            << (double) w.latencyMicros.load(std::memory_order_relaxed) / 1e6 << "\n";
+        out << "crc_chunk_seconds_count{worker=\"" << k << "\"} " << cumulative << "\n";
+    }
+
+    for(const Gauge & gauge : gauges) {
+        out << "# HELP " << gauge.name << " " << gauge.help << "\n# TYPE " << gauge.name << " gauge\n"
+            << gauge.name << " " << gauge.value() << "\n";
+    }
+    return out.str();
+}
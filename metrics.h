@@ -0,0 +1,103 @@
+/**
+ * @file metrics.h
+ *
+ * Live counters of the search, served in the Prometheus text format so long sweeps can be monitored.
+ *
+ * Each worker has its own counters, only that worker writes to them (plain relaxed loads and stores, no locked
+ * instructions), and the server thread reads them when scraped. The server listens on a Unix socket or a
+ * localhost port and answers any request with the current metrics:
+ *
+ *     curl http://127.0.0.1:9464/metrics
+ *     curl --unix-socket /tmp/crc.sock http://localhost/metrics
+ */
+#ifndef CRC_SENTENCES_METRICS_H
+#define CRC_SENTENCES_METRICS_H
+
+#include "scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Upper bounds (seconds) of the chunk latency histogram buckets, the last bucket is everything above.
+const double chunkLatencyBounds[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+const int numLatencyBuckets = sizeof(chunkLatencyBounds) / sizeof(chunkLatencyBounds[0]) + 1;
+
+/**
+ * Counters of one worker, written by that worker only.
+ */
+struct WorkerCounters
+{
+    WorkerCounters();
+
+    /**
+     * Counts a finished chunk, called by the worker.
+     */
+    void addChunk(const ChunkResult & result, double seconds);
+
+    std::atomic<uint64_t> candidates;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> nearMisses;
+    std::atomic<uint64_t> chunks;
+    std::atomic<uint64_t> latencyMicros;                  // sum of the chunk latencies
+    std::atomic<uint64_t> latencyBuckets[numLatencyBuckets];  // chunks per bucket (not cumulative)
+
+    // keeps the next worker's counters off this cache line.
+    char padding[64];
+};
+
+/**
+ * Serves the counters of all workers, plus any gauges added, in Prometheus text format.
+ */
+class MetricsServer
+{
+public:
+    /**
+     * @param address A Unix socket path (starting with '/'), or a port number to listen on at 127.0.0.1.
+     */
+    MetricsServer(const std::string & address, const std::vector<std::unique_ptr<WorkerCounters>> & workers);
+    ~MetricsServer();
+
+    /**
+     * Adds a gauge read when scraped (eg: a queue depth), must be called before start().
+     */
+    void addGauge(const std::string & name, const std::string & help, std::function<double()> value);
+
+    /**
+     * @return false if the socket could not be opened.
+     */
+    bool start();
+    void stop();
+
+private:
+    struct Gauge
+    {
+        std::string name;
+        std::string help;
+        std::function<double()> value;
+    };
+
+    void run();
+    void updateRates();
+    std::string render();
+
+    std::string address;
+    const std::vector<std::unique_ptr<WorkerCounters>> & workers;
+    std::vector<Gauge> gauges;
+
+    int listenFd = -1;
+    std::thread thread;
+    std::atomic<bool> stopRequested;
+
+    // candidates per second of each worker, over the last rate interval.
+    std::vector<uint64_t> lastCandidates;
+    std::vector<double> rates;
+    std::chrono::steady_clock::time_point lastRateTime;
+};
+
+#endif //CRC_SENTENCES_METRICS_H
@@ -0,0 +1,175 @@
+/**
+ * @file ordered_output.cpp
+ *
+ * Sorted runs and their merge, see ordered_output.h
+ */
+#include "ordered_output.h"
+#include "async_writer.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <queue>
+
+// Records read from a run at a time during the merge.
+static const size_t mergeReadRecords = 4096;
+
+// Formatted text gathered before it is passed to the writer.
+static const size_t mergeWriteBytes = 1 << 16;
+
+RunWriter::RunWriter(const std::string & path, size_t bufferRecords)
+        : path(path), file(path, std::ios::binary | std::ios::trunc), bufferRecords(bufferRecords)
+{
+    if(!file) {
+        std::cerr << "Could not create run file " << path << std::endl;
+    }
+    buffer.reserve(bufferRecords);
+}
+
+void RunWriter::emit(ResultBatch && batch)
+{
+    for(const SearchResult & result : batch) {
+        buffer.push_back(result);
+        if(buffer.size() >= bufferRecords) {
+            writeRun();
+        }
+    }
+}
+
+bool RunWriter::finish()
+{
+    writeRun();
+    file.close();
+    failed |= file.fail();
+    return !failed;
+}
+
+void RunWriter::writeRun()
+{
+    if(buffer.empty()) {
+        return;
+    }
+
+    TraceScope scope("flush run", "output");
+    scope.setArg("records", buffer.size());
+    std::sort(buffer.begin(), buffer.end(), resultOrder);
+    file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(SearchResult));
+    failed |= !file;
+
+    runs.push_back(SortedRun{recordsWritten, buffer.size()});
+    recordsWritten += buffer.size();
+    buffer.clear();
+}
+
+namespace
+{
+    /**
+     * Reads one sorted run, a buffer at a time. Runs in the same file share the stream.
+     */
+    struct RunCursor
+    {
+        std::ifstream * file;
+        uint64_t next;       // record to read next from the file
+        uint64_t end;        // record after the end of the run
+        ResultBatch buffer;
+        size_t index = 0;
+        bool truncated = false;  // the file ended part way through the run
+
+        /**
+         * @return false if the run is done, or could not be read (see truncated).
+         */
+        bool refill()
+        {
+            if(next >= end) {
+                return false;
+            }
+            size_t n = (size_t) std::min<uint64_t>(mergeReadRecords, end - next);
+            buffer.resize(n);
+            file->clear();
+            file->seekg((std::streamoff)(next * sizeof(SearchResult)));
+            file->read(reinterpret_cast<char *>(buffer.data()), n * sizeof(SearchResult));
+            if(!*file) {
+                truncated = true;
+                return false;
+            }
+            next += n;
+            index = 0;
+            return true;
+        }
+
+        const SearchResult & current() const { return buffer[index]; }
+
+        bool advance()
+        {
+            return ++index < buffer.size() || refill();
+        }
+    };
+
+    struct CursorOrder
+    {
+        bool operator()(const RunCursor * a, const RunCursor * b) const
+        {
+            // priority_queue is a max heap.
+            return resultOrder(b->current(), a->current());
+        }
+    };
+}
+
+long long mergeRuns(const std::vector<RunWriter *> & writers, const std::string & outputPath)
+{
+    TraceScope scope("merge runs", "output");
+    std::vector<std::unique_ptr<std::ifstream>> files;
+    std::vector<std::unique_ptr<RunCursor>> cursors;
+    std::priority_queue<RunCursor *, std::vector<RunCursor *>, CursorOrder> heap;
+
+    // a cursor at the start of every run.
+    bool complete = true;
+    for(RunWriter * writer : writers)
+    {
+        complete &= !writer->hasFailed();
+        files.emplace_back(new std::ifstream(writer->getPath(), std::ios::binary));
+        for(const SortedRun & run : writer->getRuns())
+        {
+            cursors.emplace_back(new RunCursor{files.back().get(), run.offset, run.offset + run.length,
+                                               ResultBatch(), 0, false});
+            if(cursors.back()->refill()) {
+                heap.push(cursors.back().get());
+            }
+        }
+    }
+
+    AsyncFileWriter out(outputPath);
+    std::string text;
+    long long count = 0;
+    while(!heap.empty())
+    {
+        RunCursor * cursor = heap.top();
+        heap.pop();
+
+        appendResult(text, cursor->current());
+        count++;
+        if(text.size() >= mergeWriteBytes) {
+            out.write(text.data(), text.size());
+            text.clear();
+        }
+
+        if(cursor->advance()) {
+            heap.push(cursor);
+        }
+    }
+    out.write(text.data(), text.size());
+    bool written = out.close();
+    for(const std::unique_ptr<RunCursor> & cursor : cursors) {
+        complete &= !cursor->truncated;
+    }
+
+    // the runs are no longer needed
+    files.clear();
+    for(RunWriter * writer : writers) {
+        std::remove(writer->getPath().c_str());
+    }
+
+    return written && complete ? count : -1;
+}
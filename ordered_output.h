@@ -0,0 +1,74 @@
+/**
+ * @file ordered_output.h
+ *
+ * Deterministic results files. Each search thread writes its results to its own run file, in sorted runs
+ * (an external sort), once the search is done the runs are merged into one file ordered by i.
+ * Reruns of the same search produce byte identical results files, regardless of thread timing.
+ */
+#ifndef CRC_SENTENCES_ORDERED_OUTPUT_H
+#define CRC_SENTENCES_ORDERED_OUTPUT_H
+
+#include "pipeline.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * Part of a run file holding sorted results.
+ */
+struct SortedRun
+{
+    uint64_t offset;  // in records
+    uint64_t length;  // in records
+};
+
+/**
+ * Result sink for one search thread. Results are buffered in memory, and written out as a sorted run
+ * once the buffer is full (or on finish), so memory use is bounded.
+ */
+class RunWriter : public ResultSink
+{
+public:
+    /**
+     * @param path File the runs are written to.
+     * @param bufferRecords Number of results held in memory before a run is written.
+     */
+    RunWriter(const std::string & path, size_t bufferRecords);
+
+    void emit(ResultBatch && batch) override;
+
+    /**
+     * Writes any buffered results as a last run, and closes the file.
+     * @return false if any run could not be written (eg: the disk is full).
+     */
+    bool finish();
+
+    bool hasFailed() const { return failed; }
+
+    const std::string & getPath() const { return path; }
+    const std::vector<SortedRun> & getRuns() const { return runs; }
+
+private:
+    void writeRun();
+
+    std::string path;
+    std::ofstream file;
+    size_t bufferRecords;
+    ResultBatch buffer;
+    std::vector<SortedRun> runs;
+    uint64_t recordsWritten = 0;
+    bool failed = false;
+};
+
+/**
+ * Streams a k-way merge of the runs of every writer into a results file, formatted with formatResult.
+ * Each run is read through a small buffer, so memory use does not depend on the number of results.
+ * The run files are deleted afterwards.
+ * @return The number of results written, or -1 if a run could not be written or read back in full, or the
+ *         output could not be written.
+ */
+long long mergeRuns(const std::vector<RunWriter *> & writers, const std::string & outputPath);
+
+#endif //CRC_SENTENCES_ORDERED_OUTPUT_H
@@ -0,0 +1,120 @@
+/**
+ * @file pipeline.cpp
+ *
+ * Result output stage of the search, see pipeline.h
+ */
+#include "pipeline.h"
+#include "sentence.h"
+#include "trace.h"
+
+std::string formatResult(const SearchResult & result)
+{
+    std::string out;
+    appendResult(out, result);
+    return out;
+}
+
+/**
+ * Same text as getInfoString.
+ */
+static void appendInfo(std::string & out, const SearchResult & result)
+{
+    out += "(i=";
+    out += std::to_string(result.i);
+    out += ", op=";
+    for(int bit=8; bit>=0; bit--) {
+        out += ((result.operation >> bit) & 1) ? '1' : '0';
+    }
+    out += ", dist=";
+    out += std::to_string((long) result.crc - (long) result.i);
+    out += ")";
+}
+
+void appendResult(std::string & out, const SearchResult & result)
+{
+    char crcString[crcStringLength];
+    writeCRCString(result.i, result.upperCase, crcString);
+    flipCRCStringCase(result.caseFlips, crcString);
+    std::string sentence = generateSentence(result.operation, std::string(crcString, crcStringLength));
+
+    if(result.hit) {
+        out += "--------------------------------------------\n";
+        out += "HIT: ";
+        appendInfo(out, result);
+        out += "\n";
+        out += sentence;
+        out += "\n--------------------------------------------\n";
+    }
+    else {
+        out += "NEAR MISS ";
+        appendInfo(out, result);
+        out += ": ";
+        out += sentence;
+        out += "\n";
+    }
+}
+
+void ResultRingSink::emit(ResultBatch && batch)
+{
+    records.clear();
+    for(const SearchResult & result : batch) {
+        records.push_back(ResultRingRecord{result.i, result.crc, result.operation, (uint8_t) result.upperCase,
+                                           result.hit ? resultRingHit : resultRingNearMiss, result.caseFlips,
+                                           {0, 0, 0}});
+    }
+    publisher.publish(ring, records.data(), records.size());
+}
+
+ResultEmitter::ResultEmitter(TextOutput & out, size_t capacity) : out(out), queue(capacity) { }
+
+ResultEmitter::~ResultEmitter()
+{
+    finish();
+}
+
+void ResultEmitter::start()
+{
+    thread = std::thread(&ResultEmitter::run, this);
+}
+
+void ResultEmitter::emit(ResultBatch && batch)
+{
+    if(!batch.empty()) {
+        queue.push(std::move(batch));
+    }
+}
+
+void ResultEmitter::finish()
+{
+    queue.close();
+    if(thread.joinable()) {
+        thread.join();
+    }
+    out.flush();
+}
+
+size_t ResultEmitter::queueDepth()
+{
+    return queue.size();
+}
+
+void ResultEmitter::run()
+{
+    traceThreadName("emitter");
+    ResultBatch batch;
+    while(queue.pop(batch))
+    {
+        // format the whole batch, then write it in one go.
+        std::string text;
+        for(const SearchResult & result : batch) {
+            appendResult(text, result);
+        }
+        out.write(text.data(), text.size());
+
+        // only flush once caught up, so heavy output is written in large blocks.
+        if(queue.size() == 0) {
+            TraceScope scope("flush", "output");
+            out.flush();
+        }
+    }
+}
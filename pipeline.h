@@ -0,0 +1,266 @@
+/**
+ * @file pipeline.h
+ *
+ * The stages after hashing: search threads check candidates and hand batches of results to an
+ * emitter thread over a bounded queue, so formatting and writing output overlaps with hashing.
+ * When the output can not keep up the queue fills, and the search threads block (backpressure)
+ * rather than buffering without limit.
+ */
+#ifndef CRC_SENTENCES_PIPELINE_H
+#define CRC_SENTENCES_PIPELINE_H
+
+#include "result_ring.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A hit or near miss, compact enough to pass between threads cheaply.
+ */
+struct SearchResult
+{
+    uint32_t i;          // the value stated by the sentence
+    uint32_t crc;        // the actual CRC of the sentence
+    uint16_t operation;  // opcode, see generateSentence
+    bool upperCase;      // case of the CRC string
+    uint8_t caseFlips = 0;  // characters of the CRC string in the other case, see CaseRepair
+    bool hit = false;    // the leading matchBits of the CRC match i, rather than a near miss
+};
+
+typedef std::vector<SearchResult> ResultBatch;
+
+/**
+ * Ordering used for deterministic output, by i, then case, then opcode, then case flips.
+ */
+inline bool resultOrder(const SearchResult & a, const SearchResult & b)
+{
+    if(a.i != b.i) return a.i < b.i;
+    if(a.upperCase != b.upperCase) return b.upperCase;
+    if(a.operation != b.operation) return a.operation < b.operation;
+    return a.caseFlips < b.caseFlips;
+}
+
+/**
+ * Somewhere the search threads send their results.
+ */
+class ResultSink
+{
+public:
+    virtual ~ResultSink() = default;
+
+    /**
+     * Takes a batch of results, may block if the sink is falling behind.
+     */
+    virtual void emit(ResultBatch && batch) = 0;
+};
+
+/**
+ * Sends results to several sinks, eg: the emitter and the shared memory ring.
+ */
+class FanOutSink : public ResultSink
+{
+public:
+    explicit FanOutSink(const std::vector<ResultSink *> & sinks) : sinks(sinks) { }
+
+    void emit(ResultBatch && batch) override
+    {
+        for(size_t k=0; k+1 < sinks.size(); k++) {
+            sinks[k]->emit(ResultBatch(batch));
+        }
+        if(!sinks.empty()) {
+            sinks.back()->emit(std::move(batch));
+        }
+    }
+
+private:
+    std::vector<ResultSink *> sinks;
+};
+
+/**
+ * Publishes one search thread's results into its ring of the shared memory, see result_ring.h
+ */
+class ResultRingSink : public ResultSink
+{
+public:
+    ResultRingSink(ResultRingPublisher & publisher, uint32_t ring) : publisher(publisher), ring(ring) { }
+
+    void emit(ResultBatch && batch) override;
+
+private:
+    ResultRingPublisher & publisher;
+    uint32_t ring;
+    std::vector<ResultRingRecord> records;
+};
+
+/**
+ * Formats a result as it is written to the console (HIT block, or NEAR MISS line).
+ */
+std::string formatResult(const SearchResult & result);
+
+/**
+ * Formats a result onto the end of out, without going through a (locale aware) stream.
+ */
+void appendResult(std::string & out, const SearchResult & result);
+
+/**
+ * Where formatted output ends up, written to from a single thread.
+ */
+class TextOutput
+{
+public:
+    virtual ~TextOutput() = default;
+    virtual void write(const char * data, size_t size) = 0;
+    virtual void flush() = 0;
+};
+
+/**
+ * Output to a std::ostream, eg: the console.
+ */
+class StreamOutput : public TextOutput
+{
+public:
+    explicit StreamOutput(std::ostream & out) : out(out) { }
+    void write(const char * data, size_t size) override { out.write(data, size); }
+    void flush() override { out.flush(); }
+
+private:
+    std::ostream & out;
+};
+
+/**
+ * Thread safe FIFO with a fixed capacity. push() blocks while full, pop() blocks while empty.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) { }
+
+    /**
+     * Adds an item, waiting for space if the queue is full.
+     * @return false if the queue was closed.
+     */
+    bool push(T && item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [&]{ return closed || items.size() < capacity; });
+        if(closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the oldest item, waiting for one if the queue is empty.
+     * @return false once the queue is closed and empty.
+     */
+    bool pop(T & item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [&]{ return closed || !items.empty(); });
+        if(items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * As pop(), but gives up once timeout has passed.
+     * @return false if there was no item, isClosed() tells whether there can be more.
+     */
+    bool popFor(T & item, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait_for(guard, timeout, [&]{ return closed || !items.empty(); });
+        if(items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * No more items will be pushed, items already queued can still be popped.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    bool isClosed()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return closed;
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return items.size();
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+/**
+ * The last stage of the pipeline, formats results and writes them from its own thread.
+ */
+class ResultEmitter : public ResultSink
+{
+public:
+    /**
+     * @param out Where results are written.
+     * @param capacity Number of batches that can be waiting before emit() blocks.
+     */
+    ResultEmitter(TextOutput & out, size_t capacity);
+    ~ResultEmitter();
+
+    void start();
+
+    /**
+     * Queues a batch of results for output, blocks if the output is falling behind.
+     */
+    void emit(ResultBatch && batch) override;
+
+    /**
+     * Writes everything still queued, then stops the emitter thread.
+     */
+    void finish();
+
+    /**
+     * @return Number of batches waiting to be written.
+     */
+    size_t queueDepth();
+
+private:
+    void run();
+
+    TextOutput & out;
+    BoundedQueue<ResultBatch> queue;
+    std::thread thread;
+};
+
+#endif //CRC_SENTENCES_PIPELINE_H
@@ -0,0 +1,270 @@
+/**
+ * @file result_ring.cpp
+ *
+ * Shared memory result rings, see result_ring.h
+ */
+#include "result_ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Offset of the first ring, after the header.
+ */
+static size_t firstRingOffset()
+{
+    return (sizeof(ResultRingHeader) + 63) & ~(size_t)63;
+}
+
+static size_t ringStride(uint32_t capacity)
+{
+    return sizeof(ResultRing) + capacity * sizeof(ResultRingRecord);
+}
+
+size_t resultRingBytes(uint32_t numRings, uint32_t capacity)
+{
+    return firstRingOffset() + numRings * ringStride(capacity);
+}
+
+/**
+ * The futexes are in shared memory, so the non private operations are used.
+ */
+static void futexWait(uint32_t * word, uint32_t expected, int timeoutMs)
+{
+    timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+static void futexWakeAll(uint32_t * word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+ResultRingMapping::~ResultRingMapping()
+{
+    unmap();
+}
+
+void ResultRingMapping::unmap()
+{
+    if(header) {
+        munmap(header, size);
+        header = nullptr;
+    }
+}
+
+ResultRing & ResultRingMapping::ring(uint32_t index)
+{
+    char * base = (char *) header + firstRingOffset() + index * ringStride(header->capacity);
+    return *(ResultRing *) base;
+}
+
+ResultRingRecord * ResultRingMapping::records(uint32_t index)
+{
+    return (ResultRingRecord *)(&ring(index) + 1);
+}
+
+ResultRingPublisher::ResultRingPublisher(const std::string & name, uint32_t numRings, uint32_t capacity)
+        : name(name)
+{
+    // at least 4 records (64 bytes), so every ring starts on a cache line.
+    uint32_t roundedCapacity = 4;
+    while(roundedCapacity < capacity) {
+        roundedCapacity <<= 1;
+    }
+
+    // start from scratch, in case a previous run left the memory behind.
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0) {
+        std::cerr << "Could not create shared memory " << name << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    size = resultRingBytes(numRings, roundedCapacity);
+    void * memory = MAP_FAILED;
+    if(ftruncate(fd, (off_t) size) == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(memory == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << name << ": " << std::strerror(errno) << std::endl;
+        shm_unlink(name.c_str());
+        return;
+    }
+
+    // the memory is zeroed, fill in the header, and publish the magic last so readers see a complete header.
+    header = (ResultRingHeader *) memory;
+    header->version = resultRingVersion;
+    header->numRings = numRings;
+    header->capacity = roundedCapacity;
+    __atomic_store_n(&header->magic, resultRingMagic, __ATOMIC_RELEASE);
+}
+
+ResultRingPublisher::~ResultRingPublisher()
+{
+    if(header) {
+        finish();
+        shm_unlink(name.c_str());
+    }
+}
+
+size_t ResultRingPublisher::publish(uint32_t index, const ResultRingRecord * in, size_t count)
+{
+    if(!header || count == 0) {
+        return 0;
+    }
+
+    ResultRing & r = ring(index);
+    ResultRingRecord * slots = records(index);
+    uint64_t mask = header->capacity - 1;
+
+    uint64_t head = r.head;
+    uint64_t tail = __atomic_load_n(&r.tail, __ATOMIC_ACQUIRE);
+    size_t space = (size_t)(header->capacity - (head - tail));
+    size_t n = std::min(space, count);
+
+    for(size_t k=0; k<n; k++) {
+        slots[(head + k) & mask] = in[k];
+    }
+    __atomic_store_n(&r.head, head + n, __ATOMIC_RELEASE);
+
+    if(n < count) {
+        __atomic_fetch_add(&r.dropped, count - n, __ATOMIC_RELAXED);
+    }
+    if(n > 0) {
+        wakeReaders();
+    }
+    return n;
+}
+
+void ResultRingPublisher::finish()
+{
+    if(header) {
+        __atomic_store_n(&header->finished, 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&header->wakeSequence, 1, __ATOMIC_SEQ_CST);
+        futexWakeAll(&header->wakeSequence);
+    }
+}
+
+void ResultRingPublisher::wakeReaders()
+{
+    // the system call is only made if a reader is asleep.
+    __atomic_fetch_add(&header->wakeSequence, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&header->readersWaiting, __ATOMIC_SEQ_CST) > 0) {
+        futexWakeAll(&header->wakeSequence);
+    }
+}
+
+ResultRingReader::ResultRingReader(const std::string & name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if(fd < 0) {
+        return;
+    }
+
+    struct stat info;
+    void * memory = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(ResultRingHeader)) {
+        size = (size_t) info.st_size;
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(memory == MAP_FAILED) {
+        return;
+    }
+
+    header = (ResultRingHeader *) memory;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != resultRingMagic
+       || header->version != resultRingVersion
+       || resultRingBytes(header->numRings, header->capacity) > size) {
+        unmap();
+    }
+}
+
+/**
+ * Copies out whatever is in the rings, taking from each ring in turn so none is starved.
+ */
+size_t ResultRingReader::take(ResultRingRecord * out, size_t max)
+{
+    size_t n = 0;
+    for(uint32_t k=0; k<header->numRings && n < max; k++)
+    {
+        uint32_t index = (nextRing + k) % header->numRings;
+        ResultRing & r = ring(index);
+        ResultRingRecord * slots = records(index);
+        uint64_t mask = header->capacity - 1;
+
+        uint64_t tail = r.tail;
+        uint64_t head = __atomic_load_n(&r.head, __ATOMIC_ACQUIRE);
+        while(tail != head && n < max) {
+            out[n++] = slots[tail & mask];
+            tail++;
+        }
+        __atomic_store_n(&r.tail, tail, __ATOMIC_RELEASE);
+    }
+    nextRing = (nextRing + 1) % header->numRings;
+    return n;
+}
+
+size_t ResultRingReader::read(ResultRingRecord * out, size_t max, int timeoutMs)
+{
+    if(!header || max == 0) {
+        return 0;
+    }
+
+    size_t n = take(out, max);
+    if(n > 0 || __atomic_load_n(&header->finished, __ATOMIC_ACQUIRE)) {
+        return n;
+    }
+
+    // nothing yet, sleep until a producer bumps the sequence (checking again after registering, to not miss it).
+    __atomic_fetch_add(&header->readersWaiting, 1, __ATOMIC_SEQ_CST);
+    uint32_t sequence = __atomic_load_n(&header->wakeSequence, __ATOMIC_SEQ_CST);
+    n = take(out, max);
+    if(n == 0 && !__atomic_load_n(&header->finished, __ATOMIC_ACQUIRE)) {
+        futexWait(&header->wakeSequence, sequence, timeoutMs);
+        n = take(out, max);
+    }
+    __atomic_fetch_sub(&header->readersWaiting, 1, __ATOMIC_SEQ_CST);
+    return n;
+}
+
+bool ResultRingReader::finished()
+{
+    if(!header) {
+        return true;
+    }
+    if(!__atomic_load_n(&header->finished, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    for(uint32_t k=0; k<header->numRings; k++) {
+        ResultRing & r = ring(k);
+        if(r.tail != __atomic_load_n(&r.head, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t ResultRingReader::dropped()
+{
+    uint64_t total = 0;
+    for(uint32_t k=0; header && k<header->numRings; k++) {
+        total += __atomic_load_n(&ring(k).dropped, __ATOMIC_RELAXED);
+    }
+    return total;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file result_ring.h
+ *
+ * Publishes results into POSIX shared memory, so other processes can consume them as they are found without
+ * pipes or parsing text. The shared memory holds one single producer / single consumer ring of fixed size
+ * records per search thread. Readers sleep on a futex in the shared header and are woken when records arrive.
+ *
+ * The search never waits on a reader, if a ring is full new records are dropped (and counted).
+ *
+ * This header is also the reader library, see ResultRingReader.
+ */
+#ifndef CRC_SENTENCES_RESULT_RING_H
+#define CRC_SENTENCES_RESULT_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// "CRCR", and the layout version. Readers refuse memory with a different version.
+const uint32_t resultRingMagic = 0x52435243;
+const uint32_t resultRingVersion = 1;
+
+const uint8_t resultRingHit = 1;
+const uint8_t resultRingNearMiss = 2;
+
+/**
+ * A result as it is stored in the shared memory, 16 bytes.
+ */
+struct ResultRingRecord
+{
+    uint32_t i;          // the value stated by the sentence
+    uint32_t crc;        // the actual CRC of the sentence
+    uint16_t operation;  // opcode, see generateSentence
+    uint8_t upperCase;   // case of the CRC string
+    uint8_t kind;        // resultRingHit or resultRingNearMiss
+    uint8_t caseFlips;   // characters of the CRC string in the other case, see CaseRepair
+    uint8_t reserved[3];
+};
+
+/**
+ * Start of the shared memory, followed by numRings rings.
+ */
+struct ResultRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numRings;
+    uint32_t capacity;        // records per ring, a power of 2
+    uint32_t wakeSequence;    // futex word, incremented when records are published
+    uint32_t readersWaiting;  // readers sleeping on wakeSequence
+    uint32_t finished;        // set by the producer when the search is over
+    uint32_t reserved;
+};
+
+/**
+ * Header of one ring, followed by capacity records. Each counter has its own cache line.
+ */
+struct ResultRing
+{
+    alignas(64) uint64_t head;   // records published, written by the producer
+    alignas(64) uint64_t tail;   // records consumed, written by the reader
+    alignas(64) uint64_t dropped; // records lost because the ring was full
+};
+
+/**
+ * Bytes of shared memory used by rings of this size.
+ */
+size_t resultRingBytes(uint32_t numRings, uint32_t capacity);
+
+/**
+ * Maps shared memory holding the rings. Used by both sides.
+ */
+class ResultRingMapping
+{
+public:
+    ResultRingMapping() = default;
+    ~ResultRingMapping();
+    ResultRingMapping(const ResultRingMapping &) = delete;
+    ResultRingMapping & operator=(const ResultRingMapping &) = delete;
+
+    bool isOpen() const { return header != nullptr; }
+    uint32_t numRings() const { return header->numRings; }
+    ResultRing & ring(uint32_t index);
+    ResultRingRecord * records(uint32_t index);
+
+protected:
+    void unmap();
+
+    ResultRingHeader * header = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * Creates the shared memory, and gives each search thread a producer.
+ */
+class ResultRingPublisher : public ResultRingMapping
+{
+public:
+    /**
+     * @param name Shared memory name, eg: "/crc-sentences".
+     * @param numRings One per search thread.
+     * @param capacity Records per ring, rounded up to a power of 2.
+     */
+    ResultRingPublisher(const std::string & name, uint32_t numRings, uint32_t capacity);
+
+    /**
+     * Marks the search finished, wakes readers and removes the name (readers keep their mapping).
+     */
+    ~ResultRingPublisher();
+
+    /**
+     * Adds records to a ring. Only one thread may publish to a given ring.
+     * @return Number of records added, the rest were dropped.
+     */
+    size_t publish(uint32_t ring, const ResultRingRecord * records, size_t count);
+
+    /**
+     * Tells readers no more records are coming.
+     */
+    void finish();
+
+private:
+    void wakeReaders();
+
+    std::string name;
+};
+
+/**
+ * The reader library, maps the shared memory of a running search and takes records from it.
+ * One reader per search.
+ */
+class ResultRingReader : public ResultRingMapping
+{
+public:
+    /**
+     * @param name Shared memory name used by the search.
+     */
+    explicit ResultRingReader(const std::string & name);
+
+    /**
+     * Takes up to max records from the rings, waiting up to timeoutMs for some to arrive.
+     * @return Number of records written to out, 0 on timeout or once finished.
+     */
+    size_t read(ResultRingRecord * out, size_t max, int timeoutMs);
+
+    /**
+     * @return True once the search is over and every record has been read.
+     */
+    bool finished();
+
+    /**
+     * @return Records dropped by the search because a ring was full.
+     */
+    uint64_t dropped();
+
+private:
+    size_t take(ResultRingRecord * out, size_t max);
+
+    uint32_t nextRing = 0;
+};
+
+#endif //CRC_SENTENCES_RESULT_RING_H
@@ -0,0 +1,52 @@
+/**
+ * @file ring_reader.cpp
+ *
+ * Example consumer of the shared memory results of a running search (see result_ring.h), prints each
+ * record as it arrives until the search finishes.
+ *
+ *     ringReader /crc-sentences
+ */
+#include "result_ring.h"
+
+#include <iostream>
+#include <memory>
+#include <thread>
+
+int main(int argc, char * argv[])
+{
+    if(argc != 2) {
+        std::cerr << "usage: ringReader <shared memory name>" << std::endl;
+        return 1;
+    }
+
+    // the search may not have created the memory yet, give it 10 seconds.
+    std::unique_ptr<ResultRingReader> ringReader(new ResultRingReader(argv[1]));
+    for(int attempt=0; !ringReader->isOpen() && attempt<100; attempt++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ringReader.reset(new ResultRingReader(argv[1]));
+    }
+    if(!ringReader->isOpen()) {
+        std::cerr << "Could not open shared memory " << argv[1] << std::endl;
+        return 1;
+    }
+    ResultRingReader & reader = *ringReader;
+
+    ResultRingRecord records[256];
+    while(!reader.finished())
+    {
+        size_t n = reader.read(records, 256, 1000);
+        for(size_t k=0; k<n; k++) {
+            const ResultRingRecord & r = records[k];
+            std::cout << (r.kind == resultRingHit ? "HIT" : "NEAR MISS")
+                      << " i=" << r.i << " crc=" << r.crc << " op=" << r.operation
+                      << (r.upperCase ? " upper" : " lower");
+            if(r.caseFlips) {
+                std::cout << " flips=" << (int) r.caseFlips;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    std::cout << "finished, " << reader.dropped() << " records dropped." << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file sampling.cpp
+ *
+ * Rate adaptive near miss output, see sampling.h
+ */
+#include "sampling.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+
+// Rough size of a near miss line, used to charge the budget without formatting anything.
+static const double nearMissLineBytes = 100;
+
+// How often the threshold is adjusted.
+static const std::chrono::seconds adaptInterval(1);
+
+// The bucket can hold this many seconds of budget, to absorb bursts.
+static const double burstSeconds = 2.0;
+
+SampledNearMissSink::SampledNearMissSink(ResultSink & out, long maxDistance, double bytesPerSecond,
+                                         size_t samplesPerFamily)
+        : out(out), maxDistance(maxDistance), bytesPerSecond(bytesPerSecond), samplesPerFamily(samplesPerFamily),
+          families(numSentenceFamilies), random(12345), tokens(bytesPerSecond * burstSeconds), threshold(maxDistance)
+{
+    windowStart = lastRefill = std::chrono::steady_clock::now();
+}
+
+void SampledNearMissSink::emit(ResultBatch && batch)
+{
+    ResultBatch passed;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+        tokens = std::min(tokens + elapsed * bytesPerSecond, bytesPerSecond * burstSeconds);
+        lastRefill = now;
+        adapt(now);
+
+        for(const SearchResult & result : batch)
+        {
+            if(result.hit) {
+                passed.push_back(result);
+                continue;
+            }
+
+            // count, and keep a uniform sample (reservoir sampling, algorithm R).
+            Family & f = families[operationFamily(result.operation)];
+            f.nearMisses++;
+            if(f.samples.size() < samplesPerFamily) {
+                f.samples.push_back(result);
+            }
+            else {
+                uint64_t slot = std::uniform_int_distribution<uint64_t>(0, f.nearMisses - 1)(random);
+                if(slot < samplesPerFamily) {
+                    f.samples[slot] = result;
+                }
+            }
+
+            // print it if it is close enough, and there is budget left.
+            long distance = std::labs((long) result.crc - (long) result.i);
+            if(distance < threshold && tokens >= nearMissLineBytes) {
+                tokens -= nearMissLineBytes;
+                windowBytes += nearMissLineBytes;
+                f.printed++;
+                passed.push_back(result);
+            }
+        }
+    }
+
+    if(!passed.empty()) {
+        out.emit(std::move(passed));
+    }
+}
+
+/**
+ * Once per interval, narrows the printing threshold if near misses were over budget, or widens it if well under.
+ * Must be called holding the lock.
+ */
+void SampledNearMissSink::adapt(std::chrono::steady_clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - windowStart).count();
+    if(elapsed < std::chrono::duration<double>(adaptInterval).count()) {
+        return;
+    }
+
+    // the wanted rate is a fraction of the budget, as near misses dropped for lack of tokens are not counted.
+    double rate = windowBytes / elapsed;
+    if(rate >= bytesPerSecond * 0.9) {
+        threshold = std::max(threshold * 3 / 4, 1L);
+    }
+    else if(rate < bytesPerSecond * 0.5 && threshold < maxDistance) {
+        threshold = std::min(threshold + std::max(threshold / 4, 1L), maxDistance);
+    }
+
+    windowBytes = 0;
+    windowStart = now;
+}
+
+void SampledNearMissSink::printSummary(std::ostream & out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    out << "near misses: family  count  printed  (final print distance " << threshold << ")" << std::endl;
+    for(int i=0; i<numSentenceFamilies; i++) {
+        out << std::setw(19) << i << "  " << families[i].nearMisses << "  " << families[i].printed << std::endl;
+    }
+
+    out << "sampled near misses:" << std::endl;
+    for(Family & f : families) {
+        std::sort(f.samples.begin(), f.samples.end(), resultOrder);
+        for(const SearchResult & result : f.samples) {
+            out << formatResult(result);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file sampling.h
+ *
+ * Keeps near miss output within a byte rate budget. Every near miss is counted exactly (per sentence family),
+ * a reservoir sample of each family is kept for the end of the run, and near misses are only passed on for
+ * output while the output rate is within budget. When over budget, the distance a near miss has to be within
+ * to be printed shrinks, and it grows back once the output has room again. Hits are always passed on.
+ *
+ * This lets nearMissDistance be widened for better statistics without the run becoming I/O bound.
+ */
+#ifndef CRC_SENTENCES_SAMPLING_H
+#define CRC_SENTENCES_SAMPLING_H
+
+#include "pipeline.h"
+#include "scheduler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <vector>
+
+class SampledNearMissSink : public ResultSink
+{
+public:
+    /**
+     * @param out Where hits and the near misses within budget go.
+     * @param maxDistance The near miss distance of the search, the printed distance never exceeds this.
+     * @param bytesPerSecond Output budget for near misses.
+     * @param samplesPerFamily Size of the reservoir kept for each family.
+     */
+    SampledNearMissSink(ResultSink & out, long maxDistance, double bytesPerSecond, size_t samplesPerFamily);
+
+    void emit(ResultBatch && batch) override;
+
+    /**
+     * Writes the per family counts and reservoir samples.
+     */
+    void printSummary(std::ostream & out);
+
+private:
+    struct Family
+    {
+        uint64_t nearMisses = 0;  // all of them, exactly
+        uint64_t printed = 0;     // passed on for output
+        ResultBatch samples;      // reservoir
+    };
+
+    void adapt(std::chrono::steady_clock::time_point now);
+
+    std::mutex lock;
+    ResultSink & out;
+    long maxDistance;
+    double bytesPerSecond;
+    size_t samplesPerFamily;
+
+    std::vector<Family> families;
+    std::mt19937 random;
+
+    // token bucket of output bytes, and the current printing threshold.
+    double tokens;
+    long threshold;
+    double windowBytes = 0;
+    std::chrono::steady_clock::time_point windowStart;
+    std::chrono::steady_clock::time_point lastRefill;
+};
+
+#endif //CRC_SENTENCES_SAMPLING_H
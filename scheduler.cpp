@@ -0,0 +1,131 @@
+/**
+ * @file scheduler.cpp
+ *
+ * Bandit style scheduling of sentence families, see scheduler.h
+ */
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+// Prior used for families that have little data, one event (hit or near miss) per this many candidates.
+// This is about what a random 32 bit hash gives with the default near miss distance.
+static const double priorCandidatesPerEvent = (double)(1 << 26);
+
+// Weight of the UCB1 exploration term, yields are normalised to 1.0 for an average family.
+static const double explorationWeight = 0.5;
+
+FamilyScheduler::FamilyScheduler(uint32_t start, uint64_t length, uint32_t chunkSize, uint32_t familyMask)
+        : end(start + length), chunkSize(std::max(chunkSize, (uint32_t)1))
+{
+    // families left out start off fully covered.
+    int searched = 0;
+    families.resize(numSentenceFamilies);
+    for(int i=0; i<numSentenceFamilies; i++) {
+        bool included = (familyMask >> i) & 1;
+        families[i].nextStart = included ? start : end;
+        searched += included ? 1 : 0;
+    }
+
+    uint64_t chunksPerFamily = (length + this->chunkSize - 1) / this->chunkSize;
+    totalChunks = chunksPerFamily * searched;
+}
+
+bool FamilyScheduler::next(WorkChunk & chunk)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    int family = pickFamily();
+    if(family < 0) {
+        return false;
+    }
+
+    Family & f = families[family];
+    chunk.family = family;
+    chunk.start_inc = (uint32_t) f.nextStart;
+    chunk.end_ex = std::min(f.nextStart + chunkSize, end);
+
+    f.nextStart += chunkSize;
+    f.chunksIssued++;
+    chunksIssued++;
+    return true;
+}
+
+void FamilyScheduler::complete(const WorkChunk & chunk, const ChunkResult & result)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Family & f = families[chunk.family];
+    f.candidates += result.candidates;
+    f.hits += result.hits;
+    f.nearMisses += result.nearMisses;
+    chunksCompleted++;
+}
+
+int FamilyScheduler::percentComplete()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(totalChunks == 0) {
+        return 100;
+    }
+    return (int)((chunksCompleted * 100) / totalChunks);
+}
+
+/**
+ * UCB1 over the families that still have work, must be called holding the lock.
+ * @return The family to work on next, or -1 if there is no work left.
+ */
+int FamilyScheduler::pickFamily()
+{
+    // yield of the average family, so the exploitation term is around 1.0
+    double totalEvents = 0, totalCandidates = 0;
+    for(const Family & f : families) {
+        totalEvents += f.hits + f.nearMisses;
+        totalCandidates += f.candidates;
+    }
+    double meanYield = (totalEvents + numSentenceFamilies)
+                     / (totalCandidates + numSentenceFamilies * priorCandidatesPerEvent);
+
+    int best = -1;
+    double bestScore = 0;
+    for(int i=0; i<numSentenceFamilies; i++)
+    {
+        const Family & f = families[i];
+        if(f.nextStart >= end) {
+            continue; // nothing left, the family is fully covered.
+        }
+
+        // make sure every family is tried before we start favouring any.
+        if(f.chunksIssued == 0) {
+            return i;
+        }
+
+        double yield = (f.hits + f.nearMisses + 1.0) / (f.candidates + priorCandidatesPerEvent);
+        double exploration = std::sqrt(2.0 * std::log((double) chunksIssued) / (double) f.chunksIssued);
+        double score = (yield / meanYield) + explorationWeight * exploration;
+
+        if(best < 0 || score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    return best;
+}
+
+void FamilyScheduler::printSummary(std::ostream & out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    out << "family  chunks  candidates  hits  near misses" << std::endl;
+    for(int i=0; i<numSentenceFamilies; i++)
+    {
+        const Family & f = families[i];
+        out << std::setw(6) << i
+            << std::setw(8) << f.chunksIssued
+            << "  " << f.candidates
+            << "  " << f.hits
+            << "  " << f.nearMisses << std::endl;
+    }
+}
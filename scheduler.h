@@ -0,0 +1,108 @@
+/**
+ * @file scheduler.h
+ *
+ * Hands out work to the search threads as (sentence family, i-block) chunks.
+ *
+ * A sentence family is the opening phrase x sentence body part of an opcode (see generateSentence),
+ * the remaining opcode bits (capitalisation, colon, full stop, length) vary within a family.
+ * Families are picked bandit style (UCB1), so families that have produced more hits / near misses
+ * get more of the worker time early on. Every chunk of every family is still handed out exactly once,
+ * so a run that finishes has covered the full search space.
+ */
+#ifndef CRC_SENTENCES_SCHEDULER_H
+#define CRC_SENTENCES_SCHEDULER_H
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// opening phrase (2 bits) x sentence body (2 bits)
+const int numSentenceFamilies = 16;
+const uint32_t allSentenceFamilies = (1 << numSentenceFamilies) - 1;
+
+/**
+ * Gets the family of an opcode (as used by generateSentence).
+ */
+inline int operationFamily(int operation)
+{
+    int basicText = operation & 0b11;
+    int openingPhrase = (operation & 0b1100000) >> 5;
+    return (openingPhrase << 2) | basicText;
+}
+
+/**
+ * A unit of work, all opcodes of one family over the i range [start_inc, end_ex).
+ * end_ex is 64 bit, so the last chunk of a full search ends at 2^32 rather than wrapping to 0.
+ */
+struct WorkChunk
+{
+    int family;
+    uint32_t start_inc;
+    uint64_t end_ex;
+};
+
+/**
+ * What came of a unit of work, fed back to the scheduler.
+ */
+struct ChunkResult
+{
+    uint64_t candidates = 0;
+    uint64_t hits = 0;
+    uint64_t nearMisses = 0;
+};
+
+/**
+ * Thread safe work queue that favours productive sentence families.
+ */
+class FamilyScheduler
+{
+public:
+    /**
+     * @param familyMask Bit f set if family f is to be searched.
+     */
+    FamilyScheduler(uint32_t start, uint64_t length, uint32_t chunkSize, uint32_t familyMask = allSentenceFamilies);
+
+    /**
+     * Gets the next chunk of work.
+     * @return false once every chunk has been handed out.
+     */
+    bool next(WorkChunk & chunk);
+
+    /**
+     * Records the yield of a chunk obtained via next().
+     */
+    void complete(const WorkChunk & chunk, const ChunkResult & result);
+
+    /**
+     * @return Completed chunks as a percentage of all chunks (0 to 100).
+     */
+    int percentComplete();
+
+    /**
+     * Writes the per family yields.
+     */
+    void printSummary(std::ostream & out);
+
+private:
+    struct Family
+    {
+        uint64_t nextStart;       // start of the next chunk to hand out
+        uint64_t chunksIssued = 0;
+        uint64_t candidates = 0;  // totals from completed chunks
+        uint64_t hits = 0;
+        uint64_t nearMisses = 0;
+    };
+
+    int pickFamily();
+
+    std::mutex lock;
+    std::vector<Family> families;
+    uint64_t end;
+    uint32_t chunkSize;
+    uint64_t chunksIssued = 0;
+    uint64_t chunksCompleted = 0;
+    uint64_t totalChunks = 0;
+};
+
+#endif //CRC_SENTENCES_SCHEDULER_H
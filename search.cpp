@@ -0,0 +1,229 @@
+/**
+ * @file search.cpp
+ *
+ * The stages of the search, see search.h
+ */
+#include "search.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+void buildTemplates(SearchModel & model, const CRCParameters & parameters, std::ostream * log)
+{
+    // lower case first, as upper case templates are only used when the CRC string has letters.
+    for(int c=0; c<2; c++) {
+        for (int operation = 0; operation < maxSentenceOperations; operation++) {
+            model.familyTemplates[operationFamily(operation)].push_back(makeSentenceTemplate(operation, c == 1));
+        }
+    }
+
+    // other hashes are not linear, the state before the digits is cached.
+    if(model.hashFunction != HashFunction::CRC) {
+        for(int f=0; f<numSentenceFamilies; f++) {
+            for(const SentenceTemplate & t : model.familyTemplates[f]) {
+                model.familyHashTemplates[f].emplace_back(model.hashFunction, t);
+            }
+        }
+        return;
+    }
+
+    // the CRC of each template as a function of i, all evaluators are made before any are compiled (they must not move).
+    for(int f=0; f<numSentenceFamilies; f++) {
+        for(const SentenceTemplate & t : model.familyTemplates[f]) {
+            model.familyEvaluators[f].emplace_back(makeLinearCRC(t, parameters));
+            model.familyRepairs[f].emplace_back(model.repairCase && !t.upperCase ? new CaseRepair(t, parameters)
+                                                                                  : nullptr);
+        }
+    }
+    if(model.compileEvaluators && CRCCompiler::supported()) {
+        for(std::vector<CRCEvaluator> & evaluators : model.familyEvaluators) {
+            for(CRCEvaluator & evaluator : evaluators) {
+                model.evaluatorCompiler.add(evaluator);
+            }
+        }
+        bool compiled = model.evaluatorCompiler.finish();
+        if(log && compiled) {
+            *log << "Compiled CRC evaluators (" << model.evaluatorCompiler.codeSize() << " bytes)." << std::endl;
+        }
+        else if(log) {
+            *log << "Could not compile CRC evaluators, interpreting them." << std::endl;
+        }
+    }
+}
+
+/**
+ * Stage 1, lists the candidates of a template in [start_inc, end_ex).
+ * Upper case templates skip values with no letters, as they would repeat the lower case sentence.
+ * @return The number of candidates written.
+ */
+inline int generateCandidates(const SentenceTemplate & t, uint32_t start_inc, uint64_t end_ex, uint32_t * candidates)
+{
+    int n = 0;
+    for(uint64_t i=start_inc; i<end_ex; i++) {
+        candidates[n] = (uint32_t) i;
+        n += (!t.upperCase || hasHexLetter((uint32_t) i)) ? 1 : 0;
+    }
+    return n;
+}
+
+/**
+ * Stage 2, calculates the CRC of the sentence for each candidate.
+ */
+inline void hashCandidates(const CRCEvaluator & evaluator, const uint32_t * candidates, int n, uint32_t * crcs)
+{
+    evaluator.evaluate(candidates, crcs, n);
+}
+
+/**
+ * Stage 2, for hashes other than CRC.
+ */
+inline void hashCandidates(const HashTemplate & hashTemplate, const uint32_t * candidates, int n, uint32_t * hashes)
+{
+    hashTemplate.evaluate(candidates, hashes, n);
+}
+
+/**
+ * Stages 1 and 2 together, for CRCs of a range of values. Every value of [start_inc, end_ex) is hashed (see
+ * LinearCRC::evaluateRange), then upper case templates drop the values with no letters.
+ * @return The number of candidates written.
+ */
+inline int hashCandidateRange(const SentenceTemplate & t, const CRCEvaluator & evaluator, uint32_t start_inc,
+                              uint64_t end_ex, uint32_t * candidates, uint32_t * crcs)
+{
+    evaluator.evaluateRange(start_inc, crcs, (size_t) (end_ex - start_inc));
+    int n = 0;
+    for(uint64_t i=start_inc; i<end_ex; i++) {
+        candidates[n] = (uint32_t) i;
+        crcs[n] = crcs[i - start_inc];
+        n += (!t.upperCase || hasHexLetter((uint32_t) i)) ? 1 : 0;
+    }
+    return n;
+}
+
+/**
+ * Stage 3, compares CRCs against the values stated, collecting the hits and near misses.
+ * Misses are also tried with the case of some of their letters changed, if repair is given.
+ * @param found Where hits and near misses are added, or nullptr to only count them.
+ */
+inline void checkCandidates(const SearchModel & model, const SentenceTemplate & t, const CaseRepair * repair,
+                            const uint32_t * candidates, const uint32_t * crcs, int n, ChunkResult & result,
+                            ResultBatch * found)
+{
+    result.candidates += n;
+    for(int k=0; k<n; k++)
+    {
+        uint32_t i = candidates[k];
+        uint32_t crc = crcs[k];
+
+        // a miss may be a hit in mixed case, the repaired sentence's CRC is the value stated.
+        uint8_t flips = repair && crc != i ? repair->repair(i, crc) : 0;
+        if(flips) {
+            result.hits++;
+            if(found) {
+                found->push_back(SearchResult{i, i, (uint16_t) t.operation, t.upperCase, flips, true});
+            }
+        }
+
+        // Check against actual crc.
+        // We report near misses (within 100), because this allows us estimate likelihood of a hit over a given time.
+        bool hit = ((crc ^ i) >> (32 - model.matchBits)) == 0;
+        if (hit) {
+            result.hits++;
+        }
+        else if (std::abs((long) crc - (long) i) < (model.nearMissDistance)) {
+            result.nearMisses++;
+        }
+        else {
+            continue;
+        }
+
+        if(found) {
+            found->push_back(SearchResult{i, crc, (uint16_t) t.operation, t.upperCase, 0, hit});
+        }
+    }
+}
+
+ChunkResult testSentences(const SearchModel & model, const uint32_t start_inc, const uint64_t end_ex,
+                          const int family, const uint32_t tileSize, ResultSink * sink)
+{
+    ChunkResult result;
+    const std::vector<SentenceTemplate> & templates = model.familyTemplates[family];
+    const std::vector<CRCEvaluator> & evaluators = model.familyEvaluators[family];
+    const std::vector<HashTemplate> & hashTemplates = model.familyHashTemplates[family];
+    const std::vector<std::unique_ptr<CaseRepair>> & repairs = model.familyRepairs[family];
+    const bool crc = model.hashFunction == HashFunction::CRC;
+
+    ResultBatch found;
+    ResultBatch * foundPtr = sink ? &found : nullptr;
+
+    uint32_t candidates[hashBatchSize];
+    uint32_t crcs[hashBatchSize];
+
+    if(model.partitioning == Partitioning::IndexMajor)
+    {
+        // loop through the integer range assigned to this thread
+        for(uint64_t i=start_inc; i<end_ex; i++)
+        {
+            // loop through different sentance types
+            for(size_t k=0; k<templates.size(); k++)
+            {
+                const SentenceTemplate & t = templates[k];
+                int n = generateCandidates(t, (uint32_t) i, i + 1, candidates);
+                if(crc) {
+                    hashCandidates(evaluators[k], candidates, n, crcs);
+                }
+                else {
+                    hashCandidates(hashTemplates[k], candidates, n, crcs);
+                }
+                checkCandidates(model, t, crc ? repairs[k].get() : nullptr, candidates, crcs, n, result, foundPtr);
+            }
+
+            if(sink && found.size() >= model.emitBatchSize) {
+                sink->emit(std::move(found));
+                found.clear();
+            }
+        }
+    }
+    else
+    {
+        // loop through the tiles of the chunk, i-block major so there is one pass over the i range
+        for(uint64_t tileStart=start_inc; tileStart<end_ex; tileStart+=tileSize)
+        {
+            uint64_t tileEnd = std::min(tileStart + tileSize, end_ex);
+            for(size_t k=0; k<templates.size(); k++)
+            {
+                const SentenceTemplate & t = templates[k];
+                for(uint64_t batchStart=tileStart; batchStart<tileEnd; batchStart+=hashBatchSize)
+                {
+                    uint64_t batchEnd = std::min(batchStart + hashBatchSize, tileEnd);
+                    int n;
+                    if(crc && model.cacheDigitPrefixes) {
+                        n = hashCandidateRange(t, evaluators[k], (uint32_t) batchStart, batchEnd, candidates, crcs);
+                    }
+                    else if(crc) {
+                        n = generateCandidates(t, (uint32_t) batchStart, batchEnd, candidates);
+                        hashCandidates(evaluators[k], candidates, n, crcs);
+                    }
+                    else {
+                        n = generateCandidates(t, (uint32_t) batchStart, batchEnd, candidates);
+                        hashCandidates(hashTemplates[k], candidates, n, crcs);
+                    }
+                    checkCandidates(model, t, crc ? repairs[k].get() : nullptr, candidates, crcs, n, result,
+                                    foundPtr);
+                }
+            }
+
+            if(sink && found.size() >= model.emitBatchSize) {
+                sink->emit(std::move(found));
+                found.clear();
+            }
+        }
+    }
+
+    // Stage 4, output is formatted and written by the sink (the emitter's thread, or a sorted run).
+    if(sink) {
+        sink->emit(std::move(found));
+    }
+
+    return result;
+}
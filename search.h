@@ -0,0 +1,97 @@
+/**
+ * @file search.h
+ *
+ * The search itself: the sentence templates of each family with the state used to hash them quickly, and the
+ * stages a chunk of i values goes through (generate, hash, check, then emit to a sink).
+ *
+ * Shared by the executable (its settings are the constants at the top of main.cpp) and the C library.
+ */
+#ifndef CRC_SENTENCES_SEARCH_H
+#define CRC_SENTENCES_SEARCH_H
+
+#include "crc_evaluator.h"
+#include "crc_parameters.h"
+#include "hash_targets.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "sentence.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// Candidates hashed per batch.
+const int hashBatchSize = 256;
+
+// Order in which a chunk is worked through.
+//   IndexMajor: for each i, every template (the original order).
+//   TemplateMajor: tiles of (template, i-block), so one template's state stays in L1 over tileSize values of i.
+enum class Partitioning { IndexMajor, TemplateMajor };
+
+/**
+ * What is searched: the hash, and the sentence templates of each family with the state used to hash them quickly.
+ */
+struct SearchModel
+{
+    // The hash the sentences are searched against (--hash).
+    HashFunction hashFunction = HashFunction::CRC;
+
+    // A near miss is within +/- this of the value stated, a hit matches it in this many leading bits.
+    int nearMissDistance = 25;
+    int matchBits = 32;
+
+    Partitioning partitioning = Partitioning::TemplateMajor;
+
+    // Results gathered before they are passed to the sink.
+    size_t emitBatchSize = 64;
+
+    // Compile each template's CRC evaluator to machine code (x86-64 only), rather than interpreting its tables.
+    bool compileEvaluators = true;
+
+    // Hash the CRCs of a batch as a range of consecutive values, looking up only the digits that changed
+    // (TemplateMajor only, see LinearCRC::evaluateRange).
+    bool cacheDigitPrefixes = true;
+
+    // Also look for hits among the sentences with some of the letters of the value in the other case (CRC only).
+    bool repairCase = true;
+
+    // Sentence templates of each family, index by family, in the order they are tested.
+    std::vector<SentenceTemplate> familyTemplates[numSentenceFamilies];
+
+    // CRC evaluator of each template, same indexes as familyTemplates, and the code compiled for them.
+    std::vector<CRCEvaluator> familyEvaluators[numSentenceFamilies];
+    CRCCompiler evaluatorCompiler;
+
+    // Case repair of each lower case template (upper case templates have none), same indexes as familyTemplates.
+    std::vector<std::unique_ptr<CaseRepair>> familyRepairs[numSentenceFamilies];
+
+    // For hashes other than CRC, the state cached per template.
+    std::vector<HashTemplate> familyHashTemplates[numSentenceFamilies];
+};
+
+/**
+ * Creates the sentence templates of every family.
+ * @param model Its hash function and settings must be set, the templates are added.
+ * @param parameters The CRC searched, if the hash function is CRC.
+ * @param log Where to say whether the evaluators were compiled, or nullptr.
+ */
+void buildTemplates(SearchModel & model, const CRCParameters & parameters, std::ostream * log);
+
+/**
+ * Generates and tests sentences for a given CRC value range.
+ * Each template is run through the stages in batches of hashBatchSize candidates, results go to the sink
+ * in batches of (up to) emitBatchSize.
+ * @param model What is searched.
+ * @param start_inc Start index (inclusive)
+ * @param end_ex End index (exclusive), up to 2^32
+ * @param family Only sentences from this family are tested (see operationFamily).
+ * @param tileSize Number of i values tested per template before moving on to the next template (TemplateMajor).
+ * @param sink Where hits and near misses are sent, or nullptr to only count them.
+ * @return Counts of what was tested and found.
+ */
+ChunkResult testSentences(const SearchModel & model, const uint32_t start_inc, const uint64_t end_ex,
+                          const int family, const uint32_t tileSize, ResultSink * sink);
+
+#endif //CRC_SENTENCES_SEARCH_H
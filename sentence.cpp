@@ -0,0 +1,208 @@
+/**
+ * @file sentence.cpp
+ *
+ * Creation of the sentences being searched, see sentence.h
+ */
+#define CRCPP_USE_CPP11
+#include "3rd_party/CRC.h"
+#include "sentence.h"
+
+#include <iomanip>
+#include <sstream>
+#include <bitset>
+#include <cmath>
+
+#include <ctype.h>
+
+// CRC lookup table, much faster than the bit by bit calculation. Rebuilt if the parameters change.
+static CRCParameters crcParameters;
+static CRC::Table<std::uint32_t, 32> crcTable(CRC::CRC_32());
+
+void setCRCParameters(const CRCParameters & parameters)
+{
+    crcParameters = parameters;
+    CRC::Parameters<std::uint32_t, 32> p = {parameters.polynomial, parameters.initialValue, parameters.finalXOR,
+                                             parameters.reflectInput, parameters.reflectOutput};
+    crcTable = CRC::Table<std::uint32_t, 32>(p);
+}
+
+const CRCParameters & getCRCParameters()
+{
+    return crcParameters;
+}
+
+uint32_t calculateCRC(const std::string & text)
+{
+    return CRC::Calculate(text.c_str(), text.length(), crcTable);
+}
+
+/**
+ * Generates a sentence.
+ * @param operation A number controlling which type of sentance to create (>= 0 and < maxSentenceOperations)
+ * @param crcString A string representing a CRC.
+ * @return
+ */
+std::string generateSentence(const int operation, const std::string & crcString)
+{
+    // parse opCode
+    int basicText = operation & 0b11;
+    bool capitalFirstLetter =  (operation & 0b100) != 0;
+    bool fullStop =  (operation & 0b1000) != 0;
+    bool col =  (operation & 0b10000) != 0;
+    int openingPhrase = (operation & 0b1100000) >> 5;
+    bool appendLength = (operation & 0b10000000) != 0 ;
+
+    // output stream
+    std::ostringstream out;
+
+    // Start sentance.
+    switch(openingPhrase) {
+        case 0:
+            // no opening
+            break;
+        case 1:
+            out << (capitalFirstLetter ? "B" : "b");
+            out << "elieve it or not, ";
+            capitalFirstLetter = false;
+            break;
+        case 2:
+            out << (capitalFirstLetter ? "U" : "u");
+            out << "seful for testing, ";
+            capitalFirstLetter = false;
+            break;
+        case 3:
+            out << (capitalFirstLetter ? "H" : "h");
+            out << "andily, ";
+            capitalFirstLetter = false;
+            break;
+    }
+
+    // Sentence body
+    switch(basicText) {
+        case 0:
+            out << (capitalFirstLetter ? "T" : "t");
+            out << "his text has a CRC of";
+            out << (col ? ": " : " ");
+            out << crcString;
+            break;
+        case 1:
+            out << (capitalFirstLetter ? "T" : "t");
+            out << "his string has a CRC of";
+            out << (col ? ": " : " ");
+            out << crcString;
+            break;
+        case 2:
+            out << (capitalFirstLetter ? "T" : "t");
+            out << "his has a CRC of";
+            out << (col ? ": " : " ");
+            out << crcString;
+            break;
+        case 3:
+            //nb: not using lower case 'i' for self
+            out << (capitalFirstLetter ? "I " : "I happen to ");
+            out << "have a CRC value of";
+            out << (col ? ": " : " ");
+            out << crcString;
+            break;
+    }
+
+    // Append a length string
+    if(appendLength) {
+        out << " and a length of ";
+
+        // calc string length including the fullstop, that may follow
+        int strLen = out.str().length() + (fullStop ? 1 : 0);
+
+        // calc string length including the number used to store the string length.
+        int charsToStoreLen =  (int) log10((double) strLen) + 1;
+        strLen += charsToStoreLen;
+
+        // and then handle the longer strLen, incrementing charsToStoreLen
+        int newCharsToStoreLen =  (int) log10((double) strLen) + 1;
+        if(newCharsToStoreLen > charsToStoreLen) {
+            strLen++;
+        }
+
+        // Done.
+        out << std::dec << strLen;
+    }
+
+    // Add a fullstop
+    if(fullStop) {
+        out << ".";
+    }
+
+    // Done.
+    return out.str();
+}
+
+
+SentenceTemplate makeSentenceTemplate(int operation, bool upperCase)
+{
+    // generate the sentence around a placeholder, and cut it out.
+    const std::string placeholder(crcStringLength, '#');
+    std::string sentence = generateSentence(operation, placeholder);
+    size_t pos = sentence.find(placeholder);
+
+    SentenceTemplate t;
+    t.operation = operation;
+    t.upperCase = upperCase;
+    t.prefix = sentence.substr(0, pos);
+    t.suffix = sentence.substr(pos + placeholder.length());
+    t.prefixCRC = CRC::Calculate(t.prefix.c_str(), t.prefix.length(), crcTable);
+    return t;
+}
+
+std::string SentenceTemplate::sentence(uint32_t crcValue) const
+{
+    char crcString[crcStringLength];
+    writeCRCString(crcValue, upperCase, crcString);
+    return prefix + std::string(crcString, crcStringLength) + suffix;
+}
+
+uint32_t SentenceTemplate::calculateCRC(uint32_t crcValue) const
+{
+    char crcString[crcStringLength];
+    writeCRCString(crcValue, upperCase, crcString);
+
+    uint32_t crc = CRC::Calculate(crcString, crcStringLength, crcTable, prefixCRC);
+    return CRC::Calculate(suffix.c_str(), suffix.length(), crcTable, crc);
+}
+
+/**
+ * Turns loop params in testCRCThread, into useful debug text.
+ */
+std::string getInfoString(long i, int operation, long hash)
+{
+    std::bitset<9> opBitset(operation);
+
+    std::ostringstream out;
+    out << "(i=" << i << ", op=" << opBitset << ", dist=" << std::dec << (hash - i) << ")";
+    return out.str();
+}
+
+/**
+ * Gets the string representation of a CRC string.
+ *
+ * @return 8 character, 0 padded hex string.
+ */
+std::string createCRCString(int crcValue, bool upperCase)
+{
+    std::ostringstream out;
+    out << std::setw(8)       // set width to 8 chars
+        << std::setfill('0')  // pad with 0's
+        << std::hex           // convert to hex
+        << crcValue;
+    std::string crcString = out.str();
+
+    // case conversion is done in place.
+    if(upperCase) {
+        for (auto & letter: crcString) letter = toupper(letter);
+    }
+
+    return crcString;
+}
+
+
+
+
@@ -0,0 +1,117 @@
+/**
+ * @file sentence.h
+ *
+ * Creation of the sentences being searched, and of the per template state used to CRC them quickly.
+ */
+#ifndef CRC_SENTENCES_SENTENCE_H
+#define CRC_SENTENCES_SENTENCE_H
+
+#include "crc_parameters.h"
+
+#include <cstdint>
+#include <string>
+
+// 512 different strings for the same CRC
+const int maxSentenceOperations = 0b100000000;
+
+// Number of characters in a CRC string.
+const int crcStringLength = 8;
+
+// Forward declarations, doxygen is in the definition.
+std::string generateSentence(const int operation, const std::string & crcString);
+std::string getInfoString(long i, int operation, long hash);
+std::string createCRCString(int crcValue, bool upperCase);
+
+/**
+ * Changes the CRC being searched (CRC-32 by default), must be called before any templates are made.
+ */
+void setCRCParameters(const CRCParameters & parameters);
+const CRCParameters & getCRCParameters();
+
+/**
+ * @return The CRC of text, with the current parameters.
+ */
+uint32_t calculateCRC(const std::string & text);
+
+/**
+ * A sentence with the CRC string left out, ie: one opcode in one case.
+ *
+ * The CRC string is always 8 characters, so the text either side of it does not change with i. This lets
+ * the CRC of the prefix be calculated once, and the suffix be kept next to it, per template.
+ */
+struct SentenceTemplate
+{
+    int operation;
+    bool upperCase;
+    std::string prefix;   // text before the CRC string
+    std::string suffix;   // text after the CRC string
+    uint32_t prefixCRC;   // CRC of prefix, used to continue the calculation.
+
+    /**
+     * @return The sentence stating crcValue.
+     */
+    std::string sentence(uint32_t crcValue) const;
+
+    /**
+     * @return The CRC of the sentence stating crcValue.
+     */
+    uint32_t calculateCRC(uint32_t crcValue) const;
+};
+
+/**
+ * Splits the sentence for an opcode and case into a SentenceTemplate.
+ */
+SentenceTemplate makeSentenceTemplate(int operation, bool upperCase);
+
+/**
+ * Writes the 8 character, 0 padded hex string for crcValue (no null terminator).
+ * A fast version of createCRCString for the inner loops.
+ */
+inline void writeCRCString(uint32_t crcValue, bool upperCase, char * out)
+{
+    const char * digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+    for(int d=crcStringLength-1; d>=0; d--) {
+        out[d] = digits[crcValue & 0xf];
+        crcValue >>= 4;
+    }
+}
+
+/**
+ * @return True if the hex string of crcValue contains a letter, ie: the upper case sentences differ from the lower case ones.
+ */
+inline bool hasHexLetter(uint32_t crcValue)
+{
+    // a nibble is a letter (>= 0xa) if bit 3 is set, along with bit 2 or 1.
+    uint32_t bit3 = crcValue & 0x88888888;
+    uint32_t bit2or1 = ((crcValue & 0x44444444) << 1) | ((crcValue & 0x22222222) << 2);
+    return (bit3 & bit2or1) != 0;
+}
+
+/**
+ * @return Bit k set if character k of the hex string of crcValue is a letter.
+ */
+inline uint8_t hexLetterMask(uint32_t crcValue)
+{
+    uint32_t bit3 = crcValue & 0x88888888;
+    uint32_t bit2or1 = ((crcValue & 0x44444444) << 1) | ((crcValue & 0x22222222) << 2);
+    uint32_t letters = bit3 & bit2or1;
+    uint8_t mask = 0;
+    for(int k=0; k<crcStringLength; k++) {
+        mask |= (uint8_t)(((letters >> (4 * (crcStringLength - 1 - k) + 3)) & 1) << k);
+    }
+    return mask;
+}
+
+/**
+ * Flips the case of the characters of a CRC string set in flips (bit k for character k), see CaseRepair.
+ */
+inline void flipCRCStringCase(uint8_t flips, char * out)
+{
+    for(int k=0; k<crcStringLength; k++) {
+        if((flips >> k) & 1) {
+            out[k] ^= 0x20;
+        }
+    }
+}
+
+#endif //CRC_SENTENCES_SENTENCE_H
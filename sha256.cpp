@@ -0,0 +1,447 @@
+/**
+ * @file sha256.cpp
+ *
+ * Truncated SHA-256 of sentences, see sha256.h
+ */
+#include "sha256.h"
+#include "sentence.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SHA256_KERNELS_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint32_t initialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+SHA256Kernel sha256Kernel()
+{
+#ifdef SHA256_KERNELS_X86
+    static const SHA256Kernel kernel = []{
+        unsigned int a, b, c, d;
+        bool sse41 = __get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_1);
+        bool sha = __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA);
+        if(sse41 && sha) {
+            return SHA256Kernel::SHANI;
+        }
+        return __builtin_cpu_supports("avx2") ? SHA256Kernel::AVX2 : SHA256Kernel::Scalar;
+    }();
+    return kernel;
+#else
+    return SHA256Kernel::Scalar;
+#endif
+}
+
+const char * sha256KernelName(SHA256Kernel kernel)
+{
+    switch(kernel) {
+        case SHA256Kernel::SHANI: return "SHA-NI";
+        case SHA256Kernel::AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+static inline uint32_t rotr(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static inline uint32_t readBigEndian(const uint8_t * p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static void expandMessage(const uint8_t * block, uint32_t * w)
+{
+    for(int t=0; t<16; t++) {
+        w[t] = readBigEndian(block + 4 * t);
+    }
+    for(int t=16; t<64; t++) {
+        uint32_t s0 = rotr(w[t-15], 7) ^ rotr(w[t-15], 18) ^ (w[t-15] >> 3);
+        uint32_t s1 = rotr(w[t-2], 17) ^ rotr(w[t-2], 19) ^ (w[t-2] >> 10);
+        w[t] = w[t-16] + s0 + w[t-7] + s1;
+    }
+}
+
+/**
+ * Runs rounds [from, to) of a block over the working variables v.
+ */
+static inline void runRounds(uint32_t * v, const uint32_t * w, int from, int to)
+{
+    uint32_t a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+    for(int t=from; t<to; t++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + (g ^ (e & (f ^ g))) + roundConstants[t] + w[t];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) | (c & (a | b)));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    v[0] = a; v[1] = b; v[2] = c; v[3] = d; v[4] = e; v[5] = f; v[6] = g; v[7] = h;
+}
+
+/**
+ * Compresses a block into state, starting from round from with the working variables start.
+ */
+static void compressScalar(uint32_t * state, const uint32_t * start, const uint8_t * block, int from)
+{
+    uint32_t w[64];
+    expandMessage(block, w);
+    uint32_t v[8];
+    std::memcpy(v, start, sizeof(v));
+    runRounds(v, w, from, 64);
+    for(int j=0; j<8; j++) {
+        state[j] += v[j];
+    }
+}
+
+/**
+ * @return The message padded to whole blocks, with its length in bits at the end.
+ */
+static std::vector<uint8_t> padMessage(const uint8_t * m, size_t length, uint64_t totalLength)
+{
+    std::vector<uint8_t> padded(m, m + length);
+    padded.push_back(0x80);
+    while(padded.size() % 64 != 56) {
+        padded.push_back(0);
+    }
+    for(int b=7; b>=0; b--) {
+        padded.push_back((uint8_t)((totalLength * 8) >> (8 * b)));
+    }
+    return padded;
+}
+
+uint32_t calculateSHA256Prefix(const std::string & text)
+{
+    std::vector<uint8_t> padded = padMessage((const uint8_t *) text.data(), text.size(), text.size());
+    uint32_t state[8];
+    std::memcpy(state, initialState, sizeof(state));
+    for(size_t b=0; b<padded.size(); b+=64) {
+        uint32_t start[8];
+        std::memcpy(start, state, sizeof(start));
+        compressScalar(state, start, padded.data() + b, 0);
+    }
+    return state[0];
+}
+
+SHA256Template::SHA256Template(const std::string & message, size_t digitOffset, bool upperCase)
+        : upperCase(upperCase)
+{
+    const uint8_t * m = (const uint8_t *) message.data();
+
+    // the blocks before the digits
+    size_t cached = digitOffset & ~(size_t) 63;
+    std::memcpy(midstate, initialState, sizeof(midstate));
+    for(size_t b=0; b<cached; b+=64) {
+        uint32_t start[8];
+        std::memcpy(start, midstate, sizeof(start));
+        compressScalar(midstate, start, m + b, 0);
+    }
+    tail = padMessage(m + cached, message.size() - cached, message.size());
+    this->digitOffset = digitOffset - cached;
+
+    // and the rounds of the next block using only words before the digits, whole groups of 4 as the
+    // SHA extensions take 4 words at a time.
+    skippedRounds = (int)(this->digitOffset / 4) & ~3;
+    uint32_t w[64];
+    expandMessage(tail.data(), w);
+    std::memcpy(roundState, midstate, sizeof(roundState));
+    runRounds(roundState, w, 0, skippedRounds);
+}
+
+void SHA256Template::evaluate(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    switch(sha256Kernel()) {
+        case SHA256Kernel::SHANI:
+            evaluateSHANI(values, hashes, n);
+            break;
+        case SHA256Kernel::AVX2:
+            evaluateAVX2(values, hashes, n);
+            break;
+        default:
+            evaluateScalar(values, hashes, n);
+            break;
+    }
+}
+
+void SHA256Template::evaluateScalar(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    std::vector<uint8_t> buffer(tail);
+    for(size_t k=0; k<n; k++)
+    {
+        writeCRCString(values[k], upperCase, (char *) buffer.data() + digitOffset);
+        uint32_t state[8];
+        std::memcpy(state, midstate, sizeof(state));
+        compressScalar(state, roundState, buffer.data(), skippedRounds);
+        for(size_t b=64; b<buffer.size(); b+=64) {
+            uint32_t start[8];
+            std::memcpy(start, state, sizeof(start));
+            compressScalar(state, start, buffer.data() + b, 0);
+        }
+        hashes[k] = state[0];
+    }
+}
+
+#ifdef SHA256_KERNELS_X86
+
+// Sentences hashed at once by the SHA extensions, each round depends on the last so one alone leaves the unit idle.
+static const int shaniMessages = 2;
+
+/**
+ * The state as the SHA extensions hold it, (A, B, E, F) and (C, D, G, H) from the high lane down.
+ */
+__attribute__((target("sha,sse4.1"))) static inline void packState(const uint32_t * state, __m128i & abef, __m128i & cdgh)
+{
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)), 0x1b);
+    abef = _mm_alignr_epi8(abcd, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, abcd, 0xf0);
+}
+
+/**
+ * Compresses a block of each of several messages, interleaved to hide the latency of the round instructions.
+ * Starts 4 * fromGroup rounds in, with the working variables (startAbef, startCdgh).
+ */
+template<int messages>
+__attribute__((target("sha,sse4.1")))
+static inline void compressSHANI(__m128i * abef, __m128i * cdgh, const __m128i * startAbef, const __m128i * startCdgh,
+                                 const uint8_t * const * blocks, int fromGroup)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i words[messages][4];
+    __m128i x[messages];
+    __m128i y[messages];
+    for(int m=0; m<messages; m++) {
+        for(int j=0; j<4; j++) {
+            words[m][j] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks[m] + 16 * j)), byteSwap);
+        }
+        x[m] = startAbef[m];
+        y[m] = startCdgh[m];
+    }
+
+#pragma GCC unroll 16
+    for(int g=0; g<16; g++)
+    {
+        const __m128i constants = _mm_loadu_si128((const __m128i *)(roundConstants + 4 * g));
+        for(int m=0; m<messages; m++)
+        {
+            // words 4g..4g+3, from the 16 before them
+            if(g >= 4) {
+                __m128i & next = words[m][g & 3];
+                next = _mm_sha256msg1_epu32(next, words[m][(g + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(words[m][(g + 3) & 3], words[m][(g + 2) & 3], 4));
+                next = _mm_sha256msg2_epu32(next, words[m][(g + 3) & 3]);
+            }
+            if(g >= fromGroup) {
+                __m128i message = _mm_add_epi32(words[m][g & 3], constants);
+                y[m] = _mm_sha256rnds2_epu32(y[m], x[m], message);
+                x[m] = _mm_sha256rnds2_epu32(x[m], y[m], _mm_shuffle_epi32(message, 0x0e));
+            }
+        }
+    }
+    for(int m=0; m<messages; m++) {
+        abef[m] = _mm_add_epi32(abef[m], x[m]);
+        cdgh[m] = _mm_add_epi32(cdgh[m], y[m]);
+    }
+}
+
+/**
+ * Hashes the tails of several sentences at once, see compressSHANI.
+ */
+template<int messages>
+__attribute__((target("sha,sse4.1")))
+static inline void hashTailsSHANI(const __m128i * mid, const __m128i * round, int fromGroup,
+                                  uint8_t * const * tails, size_t tailLength, uint32_t * hashes)
+{
+    __m128i abef[messages], cdgh[messages], startAbef[messages], startCdgh[messages];
+    const uint8_t * blocks[messages];
+    for(int m=0; m<messages; m++) {
+        abef[m] = mid[0];
+        cdgh[m] = mid[1];
+        startAbef[m] = round[0];
+        startCdgh[m] = round[1];
+        blocks[m] = tails[m];
+    }
+    compressSHANI<messages>(abef, cdgh, startAbef, startCdgh, blocks, fromGroup);
+    for(size_t b=64; b<tailLength; b+=64) {
+        for(int m=0; m<messages; m++) {
+            blocks[m] = tails[m] + b;
+        }
+        compressSHANI<messages>(abef, cdgh, abef, cdgh, blocks, 0);
+    }
+    for(int m=0; m<messages; m++) {
+        hashes[m] = (uint32_t) _mm_extract_epi32(abef[m], 3);
+    }
+}
+
+__attribute__((target("sha,sse4.1")))
+void SHA256Template::evaluateSHANI(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    __m128i mid[2], round[2];
+    packState(midstate, mid[0], mid[1]);
+    packState(roundState, round[0], round[1]);
+    const int fromGroup = skippedRounds / 4;
+
+    // a copy of the tail per sentence in flight
+    std::vector<uint8_t> buffer(tail.size() * shaniMessages);
+    uint8_t * tails[shaniMessages];
+    for(int m=0; m<shaniMessages; m++) {
+        tails[m] = buffer.data() + m * tail.size();
+        std::memcpy(tails[m], tail.data(), tail.size());
+    }
+
+    size_t k = 0;
+    for(; k+shaniMessages<=n; k+=shaniMessages) {
+        for(int m=0; m<shaniMessages; m++) {
+            writeCRCString(values[k + m], upperCase, (char *) tails[m] + digitOffset);
+        }
+        hashTailsSHANI<shaniMessages>(mid, round, fromGroup, tails, tail.size(), hashes + k);
+    }
+    for(; k<n; k++) {
+        writeCRCString(values[k], upperCase, (char *) tails[0] + digitOffset);
+        hashTailsSHANI<1>(mid, round, fromGroup, tails, tail.size(), hashes + k);
+    }
+}
+
+template<int r>
+__attribute__((target("avx2"))) static inline __m256i rotrLanes(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, r), _mm256_slli_epi32(x, 32 - r));
+}
+
+__attribute__((target("avx2"))) static inline __m256i add(__m256i a, __m256i b)
+{
+    return _mm256_add_epi32(a, b);
+}
+
+__attribute__((target("avx2"))) static inline __m256i xor3(__m256i a, __m256i b, __m256i c)
+{
+    return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+}
+
+/**
+ * 8 sentences at once, a sentence per 32 bit lane.
+ */
+__attribute__((target("avx2")))
+void SHA256Template::evaluateAVX2(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    const __m256i fifteen = _mm256_set1_epi32(15);
+    const __m256i nine = _mm256_set1_epi32(9);
+    const __m256i zero = _mm256_set1_epi32('0');
+    const __m256i letterGap = _mm256_set1_epi32((upperCase ? 'A' : 'a') - '0' - 10);
+
+    size_t k = 0;
+    for(; k+8<=n; k+=8)
+    {
+        // the hex digits of each lane's value
+        __m256i digits[crcStringLength];
+        __m256i v = _mm256_loadu_si256((const __m256i *)(values + k));
+        for(int d=0; d<crcStringLength; d++) {
+            __m256i nibble = _mm256_and_si256(_mm256_srl_epi32(v, _mm_cvtsi32_si128(4 * (crcStringLength - 1 - d))), fifteen);
+            __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi32(nibble, nine), letterGap);
+            digits[d] = add(add(nibble, zero), letter);
+        }
+
+        __m256i state[8];
+        for(int j=0; j<8; j++) {
+            state[j] = _mm256_set1_epi32((int) midstate[j]);
+        }
+
+        for(size_t b=0; b<tail.size(); b+=64)
+        {
+            // message words, the same in every lane unless they hold digits
+            __m256i w[64];
+            for(int t=0; t<16; t++) {
+                size_t p = b + 4 * t;
+                if(p + 4 <= digitOffset || p >= digitOffset + crcStringLength) {
+                    w[t] = _mm256_set1_epi32((int) readBigEndian(tail.data() + p));
+                    continue;
+                }
+                w[t] = _mm256_setzero_si256();
+                for(int j=0; j<4; j++) {
+                    __m256i byte = p + j >= digitOffset && p + j < digitOffset + crcStringLength
+                                 ? digits[p + j - digitOffset] : _mm256_set1_epi32(tail[p + j]);
+                    w[t] = _mm256_or_si256(w[t], _mm256_sll_epi32(byte, _mm_cvtsi32_si128(24 - 8 * j)));
+                }
+            }
+            for(int t=16; t<64; t++) {
+                __m256i s0 = xor3(rotrLanes<7>(w[t-15]), rotrLanes<18>(w[t-15]), _mm256_srli_epi32(w[t-15], 3));
+                __m256i s1 = xor3(rotrLanes<17>(w[t-2]), rotrLanes<19>(w[t-2]), _mm256_srli_epi32(w[t-2], 10));
+                w[t] = add(add(w[t-16], s0), add(w[t-7], s1));
+            }
+
+            // the first block starts after the rounds cached for the template
+            int from = b == 0 ? skippedRounds : 0;
+            __m256i a, bb, c, d, e, f, g, h;
+            if(b == 0) {
+                a = _mm256_set1_epi32((int) roundState[0]);
+                bb = _mm256_set1_epi32((int) roundState[1]);
+                c = _mm256_set1_epi32((int) roundState[2]);
+                d = _mm256_set1_epi32((int) roundState[3]);
+                e = _mm256_set1_epi32((int) roundState[4]);
+                f = _mm256_set1_epi32((int) roundState[5]);
+                g = _mm256_set1_epi32((int) roundState[6]);
+                h = _mm256_set1_epi32((int) roundState[7]);
+            }
+            else {
+                a = state[0]; bb = state[1]; c = state[2]; d = state[3];
+                e = state[4]; f = state[5]; g = state[6]; h = state[7];
+            }
+            for(int t=from; t<64; t++) {
+                __m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+                __m256i t1 = add(add(h, xor3(rotrLanes<6>(e), rotrLanes<11>(e), rotrLanes<25>(e))),
+                                 add(ch, add(w[t], _mm256_set1_epi32((int) roundConstants[t]))));
+                __m256i maj = _mm256_or_si256(_mm256_and_si256(a, bb), _mm256_and_si256(c, _mm256_or_si256(a, bb)));
+                __m256i t2 = add(xor3(rotrLanes<2>(a), rotrLanes<13>(a), rotrLanes<22>(a)), maj);
+                h = g;
+                g = f;
+                f = e;
+                e = add(d, t1);
+                d = c;
+                c = bb;
+                bb = a;
+                a = add(t1, t2);
+            }
+            state[0] = add(state[0], a); state[1] = add(state[1], bb);
+            state[2] = add(state[2], c); state[3] = add(state[3], d);
+            state[4] = add(state[4], e); state[5] = add(state[5], f);
+            state[6] = add(state[6], g); state[7] = add(state[7], h);
+        }
+        _mm256_storeu_si256((__m256i *)(hashes + k), state[0]);
+    }
+
+    evaluateScalar(values + k, hashes + k, n - k);
+}
+
+#else
+
+void SHA256Template::evaluateSHANI(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    evaluateScalar(values, hashes, n);
+}
+
+void SHA256Template::evaluateAVX2(const uint32_t * values, uint32_t * hashes, size_t n) const
+{
+    evaluateScalar(values, hashes, n);
+}
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file sha256.h
+ *
+ * SHA-256 of a template's sentences, truncated to the first 32 bits of the digest (the first 8 hex digits).
+ *
+ * Only the blocks from the one holding the digits on change with the value, so the state after the blocks before
+ * them (the midstate) is kept per template, and so are the rounds of the first changing block that only use the
+ * message words before the digits. What is left is hashed with the SHA extensions where the cpu has them, 8
+ * sentences at once with AVX2 otherwise, or a word at a time.
+ */
+#ifndef CRC_SENTENCES_SHA256_H
+#define CRC_SENTENCES_SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class SHA256Kernel {Scalar, AVX2, SHANI};
+
+/**
+ * @return The fastest kernel this cpu has.
+ */
+SHA256Kernel sha256Kernel();
+
+const char * sha256KernelName(SHA256Kernel kernel);
+
+/**
+ * @return The first 32 bits of the SHA-256 of text, big endian (as it is written in hex).
+ */
+uint32_t calculateSHA256Prefix(const std::string & text);
+
+/**
+ * A sentence template's message, padded, with its midstate.
+ */
+class SHA256Template
+{
+public:
+    SHA256Template() = default;
+
+    /**
+     * @param message The sentence stating 0.
+     * @param digitOffset Where the 8 hex digits are in message.
+     */
+    SHA256Template(const std::string & message, size_t digitOffset, bool upperCase);
+
+    /**
+     * Hashes the sentence stating each value.
+     */
+    void evaluate(const uint32_t * values, uint32_t * hashes, size_t n) const;
+
+private:
+    void evaluateScalar(const uint32_t * values, uint32_t * hashes, size_t n) const;
+    void evaluateSHANI(const uint32_t * values, uint32_t * hashes, size_t n) const;
+    void evaluateAVX2(const uint32_t * values, uint32_t * hashes, size_t n) const;
+
+    bool upperCase = false;
+    std::vector<uint8_t> tail;   // the padded blocks from the one holding the digits, digits are written over
+    size_t digitOffset = 0;      // where the digits are in tail
+    uint32_t midstate[8];        // state after the blocks before tail
+    int skippedRounds = 0;       // rounds of the first block of tail that come before the digits
+    uint32_t roundState[8];      // working variables after them
+};
+
+#endif //CRC_SENTENCES_SHA256_H
@@ -0,0 +1,477 @@
+/**
+ * @file solver.cpp
+ *
+ * Solver daemon, see solver.h
+ */
+#include "solver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// CRCs whose tables are kept, the least recently used is dropped when another is asked for.
+static const size_t cachedModels = 4;
+
+// Templates whose low half index is kept for "sentence with CRC X" queries. Each template has about one sentence
+// for any CRC, so a query rarely looks past these.
+static const size_t indexedTemplates = 16;
+
+// How often the server looks to see if it should stop.
+static const int pollIntervalMs = 250;
+
+// Answers queued for a client before its requests stop being read, so a client that does not read its answers
+// holds up only itself, and can not use up the daemon's memory.
+static const size_t maxUnsentBytes = 1 << 20;
+
+/**
+ * The contribution of 4 digits (first is 0 for the high half, 4 for the low half) for every value of them.
+ */
+static void halfTable(const LinearCRC & linear, int first, std::vector<uint32_t> & table)
+{
+    uint32_t upper[256], lower[256];
+    for(uint32_t n=0; n<256; n++) {
+        upper[n] = linear.digits[first][n >> 4] ^ linear.digits[first + 1][n & 0xf];
+        lower[n] = linear.digits[first + 2][n >> 4] ^ linear.digits[first + 3][n & 0xf];
+    }
+    table.resize(1 << 16);
+    for(uint32_t h=0; h<(1 << 16); h++) {
+        table[h] = upper[h >> 8] ^ lower[h & 0xff];
+    }
+}
+
+/**
+ * Indexes low(l), or low(l) ^ l for autological sentences, by key (a counting sort on the top 16 bits).
+ */
+static void buildIndex(const LinearCRC & linear, bool autological, std::vector<uint32_t> & scratch,
+                       std::vector<uint32_t> & bucketStart, std::vector<uint32_t> & keys, std::vector<uint16_t> & lows)
+{
+    halfTable(linear, 4, scratch);
+    if(autological) {
+        for(uint32_t l=0; l<(1 << 16); l++) {
+            scratch[l] ^= l;
+        }
+    }
+
+    bucketStart.assign((1 << 16) + 1, 0);
+    for(uint32_t key : scratch) {
+        bucketStart[(key >> 16) + 1]++;
+    }
+    for(size_t b=1; b<bucketStart.size(); b++) {
+        bucketStart[b] += bucketStart[b - 1];
+    }
+
+    keys.resize(1 << 16);
+    lows.resize(1 << 16);
+    std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for(uint32_t l=0; l<(1 << 16); l++) {
+        uint32_t at = fill[scratch[l] >> 16]++;
+        keys[at] = scratch[l];
+        lows[at] = (uint16_t) l;
+    }
+}
+
+/**
+ * Looks up constant ^ high(h) (^ h << 16 for autological sentences) for every high half.
+ * @return Number of results added, at most maxResults.
+ */
+static size_t probeIndex(const SentenceTemplate & t, const LinearCRC & linear, bool autological, uint32_t constant,
+                         const std::vector<uint32_t> & bucketStart, const std::vector<uint32_t> & keys,
+                         const std::vector<uint16_t> & lows, size_t maxResults, std::vector<SolverResult> & results)
+{
+    std::vector<uint32_t> high;
+    halfTable(linear, 0, high);
+
+    size_t added = 0;
+    for(uint32_t h=0; h<(1 << 16) && added < maxResults; h++)
+    {
+        uint32_t target = constant ^ high[h] ^ (autological ? h << 16 : 0);
+        for(uint32_t at=bucketStart[target >> 16]; at<bucketStart[(target >> 16) + 1]; at++)
+        {
+            if(keys[at] != target) {
+                continue;
+            }
+
+            // upper case sentences without letters are the lower case ones.
+            uint32_t value = (h << 16) | lows[at];
+            if(t.upperCase && !hasHexLetter(value)) {
+                continue;
+            }
+            uint32_t crc = linear.evaluate(value);
+            results.push_back(SolverResult{value, crc, (uint16_t) t.operation, t.upperCase, 0,
+                                           (uint16_t)(t.prefix.size() + crcStringLength + t.suffix.size()), 0});
+            added++;
+        }
+    }
+    return added;
+}
+
+CRCSolver::CRCSolver()
+{
+    for(int c=0; c<2; c++) {
+        for(int operation=0; operation<maxSentenceOperations; operation++) {
+            templates.push_back(makeSentenceTemplate(operation, c == 1));
+        }
+    }
+}
+
+/**
+ * Gets (or makes) the model of a CRC, must be called holding the lock.
+ */
+CRCSolver::Model & CRCSolver::model(const CRCParameters & parameters)
+{
+    ModelKey key(parameters.polynomial, parameters.initialValue, parameters.finalXOR,
+                 parameters.reflectInput, parameters.reflectOutput);
+    auto found = models.find(key);
+    if(found != models.end()) {
+        found->second->lastUsed = ++uses;
+        return *found->second;
+    }
+
+    if(models.size() >= cachedModels) {
+        auto oldest = std::min_element(models.begin(), models.end(), [](const auto & a, const auto & b) {
+            return a.second->lastUsed < b.second->lastUsed;
+        });
+        models.erase(oldest);
+    }
+
+    std::unique_ptr<Model> m(new Model());
+    for(const SentenceTemplate & t : templates) {
+        m->linear.push_back(makeLinearCRC(t, parameters));
+    }
+    m->lastUsed = ++uses;
+    Model & made = *m;
+    models[key] = std::move(m);
+    return made;
+}
+
+/**
+ * Finds every autological sentence of a model, must be called holding the lock.
+ */
+void CRCSolver::solveAll(Model & m)
+{
+    std::vector<uint32_t> scratch, bucketStart, keys;
+    std::vector<uint16_t> lows;
+    m.hits.clear();
+    for(size_t k=0; k<templates.size(); k++) {
+        buildIndex(m.linear[k], true, scratch, bucketStart, keys, lows);
+        probeIndex(templates[k], m.linear[k], true, m.linear[k].base, bucketStart, keys, lows,
+                   solverMaxResults, m.hits);
+    }
+    std::sort(m.hits.begin(), m.hits.end(), [](const SolverResult & a, const SolverResult & b) {
+        if(a.i != b.i) return a.i < b.i;
+        if(a.upperCase != b.upperCase) return b.upperCase != 0;
+        return a.operation < b.operation;
+    });
+    m.solved = true;
+}
+
+size_t CRCSolver::warm(const CRCParameters & parameters)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Model & m = model(parameters);
+    if(!m.solved) {
+        solveAll(m);
+    }
+    return m.hits.size();
+}
+
+void CRCSolver::autological(const CRCParameters & parameters, uint32_t maxResults, std::vector<SolverResult> & results)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Model & m = model(parameters);
+    if(!m.solved) {
+        solveAll(m);
+    }
+    size_t n = std::min((size_t) maxResults, m.hits.size());
+    results.insert(results.end(), m.hits.begin(), m.hits.begin() + n);
+}
+
+void CRCSolver::withCRC(const CRCParameters & parameters, uint32_t value, uint32_t maxResults,
+                        std::vector<SolverResult> & results)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Model & m = model(parameters);
+
+    std::vector<uint32_t> scratch, bucketStart, keys;
+    std::vector<uint16_t> lows;
+    size_t found = 0;
+    for(size_t k=0; k<templates.size() && found < maxResults; k++)
+    {
+        const LinearCRC & linear = m.linear[k];
+        if(k < indexedTemplates) {
+            if(m.lowIndexes.size() <= k) {
+                m.lowIndexes.resize(k + 1);
+            }
+            if(!m.lowIndexes[k]) {
+                std::unique_ptr<HalfIndex> index(new HalfIndex());
+                buildIndex(linear, false, scratch, index->bucketStart, index->keys, index->lows);
+                m.lowIndexes[k] = std::move(index);
+            }
+            const HalfIndex & index = *m.lowIndexes[k];
+            found += probeIndex(templates[k], linear, false, value ^ linear.base, index.bucketStart, index.keys,
+                                index.lows, maxResults - found, results);
+        }
+        else {
+            buildIndex(linear, false, scratch, bucketStart, keys, lows);
+            found += probeIndex(templates[k], linear, false, value ^ linear.base, bucketStart, keys, lows,
+                                maxResults - found, results);
+        }
+    }
+}
+
+SolverServer::SolverServer(const std::string & path, CRCSolver & solver, const CRCParameters & defaultParameters)
+        : path(path), solver(solver), defaultParameters(defaultParameters), stopRequested(false)
+{
+}
+
+SolverServer::~SolverServer()
+{
+    if(listenFd >= 0) {
+        close(listenFd);
+        unlink(path.c_str());
+    }
+}
+
+bool SolverServer::open()
+{
+    sockaddr_un local = {};
+    local.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(local.sun_path)) {
+        std::cerr << "Solver socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(local.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listenFd < 0 || bind(listenFd, (sockaddr *) &local, sizeof(local)) != 0 || listen(listenFd, 16) != 0) {
+        std::cerr << "Could not serve on " << path << ": " << std::strerror(errno) << std::endl;
+        if(listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        return false;
+    }
+    return true;
+}
+
+void SolverServer::stop()
+{
+    stopRequested = true;
+}
+
+static bool sendAll(int connection, const void * data, size_t size)
+{
+    const char * bytes = (const char *) data;
+    while(size > 0) {
+        ssize_t n = send(connection, bytes, size, MSG_NOSIGNAL);
+        if(n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * Sends as much of output as the connection takes without blocking, removing what was sent.
+ * @return false if the connection failed.
+ */
+static bool sendUnsent(int connection, std::string & output)
+{
+    size_t sent = 0;
+    while(sent < output.size()) {
+        ssize_t n = send(connection, output.data() + sent, output.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if(n <= 0) {
+            return false;
+        }
+        sent += (size_t) n;
+    }
+    output.erase(0, sent);
+    return true;
+}
+
+void SolverServer::run()
+{
+    // the listening socket first, then a connection per client with what it has sent so far, and the answers
+    // not yet sent to it. Connections are non-blocking, so a client that stops reading does not hold up the rest.
+    std::vector<pollfd> polled = {{listenFd, POLLIN, 0}};
+    std::vector<std::string> pending(1);
+    std::vector<std::string> unsent(1);
+    std::vector<bool> finished(1);  // the client has sent all its requests, close once they are answered
+
+    while(!stopRequested)
+    {
+        if(poll(polled.data(), polled.size(), pollIntervalMs) <= 0) {
+            continue;
+        }
+
+        for(size_t k=polled.size(); k-- > 1; )
+        {
+            if(polled[k].revents == 0) {
+                continue;
+            }
+            bool open = (polled[k].revents & (POLLERR | POLLNVAL)) == 0;
+            if(open && !finished[k] && (polled[k].revents & (POLLIN | POLLHUP))) {
+                char buffer[4096];
+                ssize_t n = recv(polled[k].fd, buffer, sizeof(buffer), 0);
+                if(n > 0) {
+                    pending[k].append(buffer, (size_t) n);
+                    answer(pending[k], unsent[k]);
+                }
+                else if(n == 0) {
+                    finished[k] = true;
+                }
+                else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    open = false;
+                }
+            }
+            open = open && sendUnsent(polled[k].fd, unsent[k]) && !(finished[k] && unsent[k].empty());
+
+            if(!open) {
+                close(polled[k].fd);
+                polled.erase(polled.begin() + k);
+                pending.erase(pending.begin() + k);
+                unsent.erase(unsent.begin() + k);
+                finished.erase(finished.begin() + k);
+                continue;
+            }
+            polled[k].events = (short)((!finished[k] && unsent[k].size() < maxUnsentBytes ? POLLIN : 0)
+                                       | (unsent[k].empty() ? 0 : POLLOUT));
+        }
+
+        if(polled[0].revents & POLLIN) {
+            int connection = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if(connection >= 0) {
+                polled.push_back({connection, POLLIN, 0});
+                pending.emplace_back();
+                unsent.emplace_back();
+                finished.push_back(false);
+            }
+        }
+    }
+
+    for(size_t k=1; k<polled.size(); k++) {
+        close(polled[k].fd);
+    }
+}
+
+void SolverServer::answer(std::string & pending, std::string & output)
+{
+    while(pending.size() >= sizeof(SolverRequest))
+    {
+        SolverRequest request;
+        std::memcpy(&request, pending.data(), sizeof(request));
+        pending.erase(0, sizeof(request));
+
+        auto startTime = std::chrono::steady_clock::now();
+        SolverResponse response = {solverMagic, solverOk, 0, 0, 0};
+        std::vector<SolverResult> results;
+
+        if(request.magic != solverMagic || request.version != solverVersion
+           || (request.kind != solverAutological && request.kind != solverCRC)) {
+            response.status = solverBadRequest;
+        }
+        else {
+            CRCParameters parameters = defaultParameters;
+            if(request.polynomial != 0) {
+                parameters.polynomial = request.polynomial;
+                parameters.initialValue = request.initialValue;
+                parameters.finalXOR = request.finalXOR;
+                parameters.reflectInput = request.reflectInput != 0;
+                parameters.reflectOutput = request.reflectOutput != 0;
+            }
+            uint32_t maxResults = std::min(request.maxResults, solverMaxResults);
+            if(request.kind == solverAutological) {
+                solver.autological(parameters, maxResults, results);
+            }
+            else {
+                solver.withCRC(parameters, request.value, maxResults, results);
+            }
+        }
+
+        // the results, each followed by its sentence.
+        std::string body;
+        for(const SolverResult & result : results) {
+            SentenceTemplate t = makeSentenceTemplate(result.operation, result.upperCase != 0);
+            body.append((const char *) &result, sizeof(result));
+            body += t.sentence(result.i);
+        }
+        response.count = (uint32_t) results.size();
+        response.micros = (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - startTime).count();
+
+        output.append((const char *) &response, sizeof(response));
+        output += body;
+    }
+}
+
+int connectSolver(const std::string & path)
+{
+    sockaddr_un remote = {};
+    remote.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(remote.sun_path)) {
+        return -1;
+    }
+    std::strcpy(remote.sun_path, path.c_str());
+
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(connection >= 0 && connect(connection, (sockaddr *) &remote, sizeof(remote)) != 0) {
+        close(connection);
+        connection = -1;
+    }
+    return connection;
+}
+
+static bool receiveAll(int connection, void * data, size_t size)
+{
+    char * bytes = (char *) data;
+    while(size > 0) {
+        ssize_t n = recv(connection, bytes, size, 0);
+        if(n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+bool querySolver(int connection, const SolverRequest & request, SolverResponse & response,
+                 std::vector<SolverResult> & results, std::vector<std::string> & sentences)
+{
+    results.clear();
+    sentences.clear();
+    if(!sendAll(connection, &request, sizeof(request)) || !receiveAll(connection, &response, sizeof(response))
+       || response.magic != solverMagic) {
+        return false;
+    }
+
+    for(uint32_t k=0; k<response.count; k++) {
+        SolverResult result;
+        if(!receiveAll(connection, &result, sizeof(result))) {
+            return false;
+        }
+        std::string sentence(result.length, '\0');
+        if(!receiveAll(connection, &sentence[0], sentence.size())) {
+            return false;
+        }
+        results.push_back(result);
+        sentences.push_back(sentence);
+    }
+    return response.status == solverOk;
+}
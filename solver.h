@@ -0,0 +1,204 @@
+/**
+ * @file solver.h
+ *
+ * A long running solver that answers "autological sentence for CRC A" and "sentence with CRC X" queries over a
+ * Unix socket, without sweeping.
+ *
+ * Using the digit tables of a template (see crc_evaluator.h), with the value split into its high and low 4 digits:
+ *
+ *     crc(value) = base ^ high(value >> 16) ^ low(value & 0xffff)
+ *
+ * So a sentence with CRC X is a high half where X ^ base ^ high(h) is in the set of low(l), and an autological
+ * sentence is one where base ^ high(h) ^ (h << 16) is in the set of low(l) ^ l. Each is 2^16 table entries and
+ * 2^16 lookups per template (meet in the middle), instead of 2^32 CRCs.
+ *
+ * The daemon keeps, per CRC, the digit tables of every template, the low half index of the first few templates
+ * and every autological sentence once they have been asked for (the hit cache).
+ *
+ * The protocol is fixed size structs in the byte order of the machine, a client sends a SolverRequest and gets a
+ * SolverResponse followed by count SolverResults, each followed by its sentence. A connection can send any number
+ * of requests. This header is also the client library, see solver_client.cpp for an example.
+ */
+#ifndef CRC_SENTENCES_SOLVER_H
+#define CRC_SENTENCES_SOLVER_H
+
+#include "crc_evaluator.h"
+#include "crc_parameters.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// "CRCS", and the protocol version. Requests with another version are refused.
+const uint32_t solverMagic = 0x53435243;
+const uint16_t solverVersion = 1;
+
+// Request kinds.
+const uint16_t solverAutological = 1;  // sentences stating their own CRC
+const uint16_t solverCRC = 2;          // sentences with the CRC value
+
+// Response status.
+const uint16_t solverOk = 0;
+const uint16_t solverBadRequest = 1;
+
+// Most results returned for one request.
+const uint32_t solverMaxResults = 1024;
+
+/**
+ * A query, 36 bytes. A polynomial of 0 means the CRC the daemon was started with.
+ */
+struct SolverRequest
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;           // solverAutological or solverCRC
+    uint32_t value;          // the CRC wanted (solverCRC)
+    uint32_t maxResults;
+    uint32_t polynomial;
+    uint32_t initialValue;
+    uint32_t finalXOR;
+    uint8_t reflectInput;
+    uint8_t reflectOutput;
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+/**
+ * The answer, followed by count results.
+ */
+struct SolverResponse
+{
+    uint32_t magic;
+    uint16_t status;
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t micros;         // time taken to answer
+};
+
+/**
+ * A sentence found, followed by its text (length bytes, no terminator).
+ */
+struct SolverResult
+{
+    uint32_t i;              // the value stated by the sentence
+    uint32_t crc;            // the CRC of the sentence
+    uint16_t operation;      // opcode, see generateSentence
+    uint8_t upperCase;       // case of the CRC string
+    uint8_t reserved;
+    uint16_t length;         // of the sentence
+    uint16_t reserved2;
+};
+
+/**
+ * Solves queries against the templates, keeping what it works out per CRC. Thread safe.
+ */
+class CRCSolver
+{
+public:
+    CRCSolver();
+
+    /**
+     * Works out the autological sentences of a CRC ahead of the first query.
+     * @return The number of them.
+     */
+    size_t warm(const CRCParameters & parameters);
+
+    /**
+     * Finds sentences stating their own CRC (all of them are found, and kept).
+     */
+    void autological(const CRCParameters & parameters, uint32_t maxResults, std::vector<SolverResult> & results);
+
+    /**
+     * Finds sentences with a CRC of value, trying templates in order until there are maxResults.
+     */
+    void withCRC(const CRCParameters & parameters, uint32_t value, uint32_t maxResults,
+                 std::vector<SolverResult> & results);
+
+private:
+    /**
+     * Templates split on their high and low 4 digits, for one half of the value.
+     * Entries are bucketed on the top 16 bits of their key.
+     */
+    struct HalfIndex
+    {
+        std::vector<uint32_t> bucketStart;  // 2^16 + 1
+        std::vector<uint32_t> keys;
+        std::vector<uint16_t> lows;
+    };
+
+    /**
+     * What is kept for one CRC.
+     */
+    struct Model
+    {
+        std::vector<LinearCRC> linear;               // same order as templates
+        std::vector<std::unique_ptr<HalfIndex>> lowIndexes;  // of low(l), the first few templates
+        std::vector<SolverResult> hits;              // the hit cache, text is not included
+        bool solved = false;                         // hits holds every autological sentence
+        uint64_t lastUsed = 0;
+    };
+
+    typedef std::tuple<uint32_t, uint32_t, uint32_t, bool, bool> ModelKey;
+
+    Model & model(const CRCParameters & parameters);
+    void solveAll(Model & m);
+
+    std::mutex lock;
+    std::vector<SentenceTemplate> templates;  // lower case, then upper case
+    std::map<ModelKey, std::unique_ptr<Model>> models;
+    uint64_t uses = 0;
+};
+
+/**
+ * Serves a solver on a Unix socket.
+ */
+class SolverServer
+{
+public:
+    SolverServer(const std::string & path, CRCSolver & solver, const CRCParameters & defaultParameters);
+    ~SolverServer();
+
+    /**
+     * @return false if the socket could not be opened.
+     */
+    bool open();
+
+    /**
+     * Answers requests until stop() is called (from a signal handler or another thread).
+     */
+    void run();
+    void stop();
+
+private:
+    /**
+     * Answers the complete requests read from a connection, appending the answers to output.
+     */
+    void answer(std::string & pending, std::string & output);
+
+    std::string path;
+    CRCSolver & solver;
+    CRCParameters defaultParameters;
+    int listenFd = -1;
+    std::atomic<bool> stopRequested;
+};
+
+/**
+ * Connects to a solver, for clients.
+ * @return The socket, or -1.
+ */
+int connectSolver(const std::string & path);
+
+/**
+ * Sends a request and reads the results, for clients.
+ * @param sentences The text of each result.
+ * @return false if the daemon could not be reached, or refused the request (status is set).
+ */
+bool querySolver(int connection, const SolverRequest & request, SolverResponse & response,
+                 std::vector<SolverResult> & results, std::vector<std::string> & sentences);
+
+#endif //CRC_SENTENCES_SOLVER_H
@@ -0,0 +1,61 @@
+/**
+ * @file solver_client.cpp
+ *
+ * Example client of the solver daemon (see solver.h), asks one question and prints the sentences.
+ *
+ *     solverClient /tmp/crc-solver.sock autological
+ *     solverClient /tmp/crc-solver.sock 1234abcd crc32c
+ */
+#include "solver.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include <unistd.h>
+
+int main(int argc, char * argv[])
+{
+    if(argc < 3 || argc > 4) {
+        std::cerr << "usage: solverClient <socket> <autological|hex CRC> [CRC name or parameters]" << std::endl;
+        return 1;
+    }
+
+    SolverRequest request = {solverMagic, solverVersion, solverAutological, 0, 16, 0, 0, 0, 0, 0, 0, 0};
+    if(std::string(argv[2]) != "autological") {
+        request.kind = solverCRC;
+        request.value = (uint32_t) std::strtoul(argv[2], nullptr, 16);
+    }
+    if(argc == 4) {
+        CRCParameters parameters;
+        if(!parseCRCParameters(argv[3], parameters, std::cerr)) {
+            return 1;
+        }
+        request.polynomial = parameters.polynomial;
+        request.initialValue = parameters.initialValue;
+        request.finalXOR = parameters.finalXOR;
+        request.reflectInput = parameters.reflectInput;
+        request.reflectOutput = parameters.reflectOutput;
+    }
+
+    int connection = connectSolver(argv[1]);
+    if(connection < 0) {
+        std::cerr << "Could not connect to " << argv[1] << std::endl;
+        return 1;
+    }
+
+    SolverResponse response;
+    std::vector<SolverResult> results;
+    std::vector<std::string> sentences;
+    bool ok = querySolver(connection, request, response, results, sentences);
+    close(connection);
+    if(!ok) {
+        std::cerr << "The solver did not answer the request." << std::endl;
+        return 1;
+    }
+
+    for(size_t k=0; k<results.size(); k++) {
+        std::cout << createCRCString(results[k].crc, false) << "  " << sentences[k] << std::endl;
+    }
+    std::cout << results.size() << " sentences in " << response.micros << "us." << std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file trace.cpp
+ *
+ * Chrome trace events, see trace.h
+ */
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> traceEnabled(false);
+
+struct TraceEvent
+{
+    const char * name;
+    const char * category;
+    int64_t start;      // microseconds since the trace started
+    int64_t duration;
+    int numArgs;
+    const char * argNames[2];
+    uint64_t args[2];
+};
+
+struct TraceBuffer
+{
+    std::string threadName;
+    std::vector<TraceEvent> events;
+};
+
+// Every thread's buffer, kept after the thread exits. Only touched under the lock when a thread makes its buffer.
+static std::mutex buffersLock;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+static std::chrono::steady_clock::time_point traceStart;
+
+/**
+ * @return This thread's buffer, made on first use.
+ */
+static TraceBuffer & threadBuffer()
+{
+    thread_local TraceBuffer * buffer = nullptr;
+    if(!buffer) {
+        std::lock_guard<std::mutex> guard(buffersLock);
+        buffers.emplace_back(new TraceBuffer());
+        buffer = buffers.back().get();
+        buffer->threadName = "thread " + std::to_string(buffers.size() - 1);
+    }
+    return *buffer;
+}
+
+void startTrace()
+{
+    traceStart = std::chrono::steady_clock::now();
+    traceEnabled = true;
+}
+
+void traceThreadName(const std::string & name)
+{
+    if(traceEnabled) {
+        threadBuffer().threadName = name;
+    }
+}
+
+int64_t TraceScope::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+void TraceScope::record()
+{
+    TraceEvent event = {name, category, start, now() - start, numArgs, {argNames[0], argNames[1]}, {args[0], args[1]}};
+    threadBuffer().events.push_back(event);
+}
+
+/**
+ * Names are string literals in this program, but escape them anyway.
+ */
+static void writeString(std::ostream & out, const std::string & text)
+{
+    out << '"';
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+bool writeTrace(const std::string & path)
+{
+    std::ofstream out(path);
+    out.imbue(std::locale::classic());
+    out << "{\"traceEvents\":[\n";
+
+    std::lock_guard<std::mutex> guard(buffersLock);
+    bool first = true;
+    for(size_t tid=0; tid<buffers.size(); tid++)
+    {
+        const TraceBuffer & buffer = *buffers[tid];
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":";
+        writeString(out, buffer.threadName);
+        out << "}}";
+        first = false;
+
+        for(const TraceEvent & event : buffer.events) {
+            out << ",\n{\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":";
+            writeString(out, event.category);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << event.start
+                << ",\"dur\":" << event.duration;
+            if(event.numArgs > 0) {
+                out << ",\"args\":{";
+                for(int k=0; k<event.numArgs; k++) {
+                    out << (k ? "," : "");
+                    writeString(out, event.argNames[k]);
+                    out << ":" << event.args[k];
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return (bool) out;
+}
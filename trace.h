@@ -0,0 +1,86 @@
+/**
+ * @file trace.h
+ *
+ * Optional timeline of what each thread spent its time on, written as Chrome trace event JSON
+ * (load it in chrome://tracing or https://ui.perfetto.dev) to spot load imbalance and stalls.
+ *
+ * Events are recorded into a buffer per thread, no locking, and only written out at the end by writeTrace().
+ * When tracing is off a TraceScope costs a single flag check.
+ *
+ *     {
+ *         TraceScope scope("chunk", "search");
+ *         scope.setArg("family", family);
+ *         ...
+ *     }
+ */
+#ifndef CRC_SENTENCES_TRACE_H
+#define CRC_SENTENCES_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+extern std::atomic<bool> traceEnabled;
+
+/**
+ * Starts recording events.
+ */
+void startTrace();
+
+/**
+ * Names the calling thread in the timeline.
+ */
+void traceThreadName(const std::string & name);
+
+/**
+ * Writes every thread's events as a Chrome trace JSON file, call once the threads are done.
+ * @return false if the file could not be written.
+ */
+bool writeTrace(const std::string & path);
+
+/**
+ * Records the time from construction to destruction as an event of the calling thread.
+ * name, category and argument names must be string literals (they are kept as pointers).
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char * name, const char * category)
+            : name(name), category(category), start(traceEnabled.load(std::memory_order_relaxed) ? now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if(start >= 0) {
+            record();
+        }
+    }
+
+    /**
+     * Attaches a value shown with the event, up to two.
+     */
+    void setArg(const char * argName, uint64_t value)
+    {
+        if(numArgs < 2) {
+            argNames[numArgs] = argName;
+            args[numArgs++] = value;
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope & operator=(const TraceScope &) = delete;
+
+private:
+    static int64_t now();
+    void record();
+
+    const char * name;
+    const char * category;
+    int64_t start;
+    int numArgs = 0;
+    const char * argNames[2];
+    uint64_t args[2];
+};
+
+#endif //CRC_SENTENCES_TRACE_H
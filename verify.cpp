@@ -0,0 +1,327 @@
+/**
+ * @file verify.cpp
+ *
+ * Bulk verification of sentences, see verify.h
+ */
+#include "verify.h"
+#include "sentence.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint32_t reflect32(uint32_t value)
+{
+    uint32_t reflected = 0;
+    for(int b=0; b<32; b++) {
+        reflected |= ((value >> b) & 1) << (31 - b);
+    }
+    return reflected;
+}
+
+SlicedCRC::SlicedCRC(const CRCParameters & parameters)
+        : reflectInput(parameters.reflectInput), reflectOutput(parameters.reflectOutput),
+          initialValue(parameters.initialValue), finalXOR(parameters.finalXOR)
+{
+    // a reflected register shifts right, least significant bit first, so the polynomial is reflected too.
+    // The initial value is not, it is taken as the register as CRC++ does (the search uses CRC++).
+    if(reflectInput) {
+        uint32_t polynomial = reflect32(parameters.polynomial);
+        for(uint32_t n=0; n<256; n++) {
+            uint32_t crc = n;
+            for(int b=0; b<8; b++) {
+                crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+            }
+            tables[0][n] = crc;
+        }
+        for(int k=1; k<8; k++) {
+            for(uint32_t n=0; n<256; n++) {
+                tables[k][n] = (tables[k - 1][n] >> 8) ^ tables[0][tables[k - 1][n] & 0xff];
+            }
+        }
+    }
+    else {
+        for(uint32_t n=0; n<256; n++) {
+            uint32_t crc = n << 24;
+            for(int b=0; b<8; b++) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ parameters.polynomial : crc << 1;
+            }
+            tables[0][n] = crc;
+        }
+        for(int k=1; k<8; k++) {
+            for(uint32_t n=0; n<256; n++) {
+                tables[k][n] = (tables[k - 1][n] << 8) ^ tables[0][tables[k - 1][n] >> 24];
+            }
+        }
+    }
+}
+
+uint32_t SlicedCRC::calculate(const char * data, size_t size) const
+{
+    const uint8_t * bytes = (const uint8_t *) data;
+    uint32_t crc = initialValue;
+
+    if(reflectInput) {
+        for(; size >= 8; size -= 8, bytes += 8) {
+            uint32_t low = crc ^ ((uint32_t) bytes[0] | (uint32_t) bytes[1] << 8
+                                  | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24);
+            crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff]
+                ^ tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24]
+                ^ tables[3][bytes[4]] ^ tables[2][bytes[5]] ^ tables[1][bytes[6]] ^ tables[0][bytes[7]];
+        }
+        for(; size > 0; size--, bytes++) {
+            crc = (crc >> 8) ^ tables[0][(crc ^ *bytes) & 0xff];
+        }
+    }
+    else {
+        for(; size >= 8; size -= 8, bytes += 8) {
+            uint32_t high = crc ^ ((uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16
+                                   | (uint32_t) bytes[2] << 8 | (uint32_t) bytes[3]);
+            crc = tables[7][high >> 24] ^ tables[6][(high >> 16) & 0xff]
+                ^ tables[5][(high >> 8) & 0xff] ^ tables[4][high & 0xff]
+                ^ tables[3][bytes[4]] ^ tables[2][bytes[5]] ^ tables[1][bytes[6]] ^ tables[0][bytes[7]];
+        }
+        for(; size > 0; size--, bytes++) {
+            crc = (crc << 8) ^ tables[0][(crc >> 24) ^ *bytes];
+        }
+    }
+
+    // the register is reflected if the input was, the output is reflected if it differs.
+    if(reflectInput != reflectOutput) {
+        crc = reflect32(crc);
+    }
+    return crc ^ finalXOR;
+}
+
+/**
+ * Class of each character: 0 not part of a word, 1 a letter that is not a hex digit, else 2 + the digit's value.
+ */
+struct CharacterClasses
+{
+    CharacterClasses()
+    {
+        for(int c=0; c<256; c++) {
+            bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            classes[c] = letter ? 1 : 0;
+        }
+        for(int d=0; d<16; d++) {
+            classes[(uint8_t) "0123456789abcdef"[d]] = (uint8_t)(2 + d);
+            classes[(uint8_t) "0123456789ABCDEF"[d]] = (uint8_t)(2 + d);
+        }
+    }
+
+    uint8_t classes[256];
+};
+
+static const CharacterClasses characterClasses;
+
+/**
+ * Finds the first word of exactly 8 hex digits.
+ * Any 8 characters in a row include one at every 8th position, so only those are looked at, and the run of hex
+ * digits around one is only measured if it is a hex digit.
+ * @return The end of the word, or nullptr if there is none.
+ */
+static const char * findStatedValue(const char * line, const char * end, uint32_t & value)
+{
+    const uint8_t * classes = characterClasses.classes;
+    for(const char * probe = line + crcStringLength - 1; probe < end; probe += crcStringLength)
+    {
+        if(classes[(uint8_t) *probe] < 2) {
+            continue;
+        }
+
+        const char * first = probe;
+        while(first > line && classes[(uint8_t) first[-1]] >= 2) {
+            first--;
+        }
+        const char * last = probe + 1;
+        while(last < end && classes[(uint8_t) *last] >= 2) {
+            last++;
+        }
+
+        if(last - first == crcStringLength && (first == line || classes[(uint8_t) first[-1]] == 0)
+           && (last == end || classes[(uint8_t) *last] == 0)) {
+            uint32_t parsed = 0;
+            for(const char * digit = first; digit < last; digit++) {
+                parsed = (parsed << 4) | (uint32_t)(classes[(uint8_t) *digit] - 2);
+            }
+            value = parsed;
+            return last;
+        }
+
+        // the next word starts after this run.
+        probe = last - 1;
+    }
+    return nullptr;
+}
+
+/**
+ * Finds the number after "length of ", which follows the value in every sentence.
+ */
+static bool findStatedLength(const char * from, const char * end, uint64_t & length)
+{
+    static const char key[] = "length of ";
+    const size_t keyLength = sizeof(key) - 1;
+    for(const char * at = from; at + keyLength < end; at++)
+    {
+        if(*at != 'l' || std::memcmp(at, key, keyLength) != 0) {
+            continue;
+        }
+        const char * digit = at + keyLength;
+        if(*digit < '0' || *digit > '9') {
+            return false;
+        }
+        length = 0;
+        for(; digit < end && *digit >= '0' && *digit <= '9'; digit++) {
+            length = length * 10 + (uint64_t)(*digit - '0');
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * What one thread found in its part of the file.
+ */
+struct VerifyPart
+{
+    const char * begin;
+    const char * end;
+    VerifyResult result;
+    std::vector<std::pair<uint64_t, std::string>> failures;  // line within the part, and why
+};
+
+static void verifyPart(VerifyPart & part, const VerifyOptions & options, const SlicedCRC & crc)
+{
+    const uint32_t matchMask = options.matchBits >= 32 ? 0xffffffff : ~(0xffffffffu >> options.matchBits);
+    const char * line = part.begin;
+    while(line < part.end)
+    {
+        const char * newline = (const char *) std::memchr(line, '\n', (size_t)(part.end - line));
+        const char * lineEnd = newline ? newline : part.end;
+        size_t size = (size_t)(lineEnd - line);
+        if(size > 0 && line[size - 1] == '\r') {
+            size--;
+        }
+
+        // blank lines are not checked, but still numbered.
+        if(size > 0)
+        {
+            const char * why = nullptr;
+            uint32_t stated;
+            uint64_t statedLength;
+            const char * valueEnd = findStatedValue(line, line + size, stated);
+            if(!valueEnd) {
+                part.result.noValue++;
+                why = "no CRC";
+            }
+            else {
+                uint32_t hash = options.hashFunction == HashFunction::CRC
+                              ? crc.calculate(line, size)
+                              : calculateHash(options.hashFunction, std::string(line, size));
+                if(((hash ^ stated) & matchMask) != 0) {
+                    part.result.wrongHash++;
+                    why = "wrong CRC";
+                }
+                else if(findStatedLength(valueEnd, line + size, statedLength) && statedLength != size) {
+                    part.result.wrongLength++;
+                    why = "wrong length";
+                }
+                else {
+                    part.result.valid++;
+                }
+            }
+
+            if(why && part.failures.size() < options.maxReported) {
+                part.failures.push_back({part.result.lines, std::string(why) + ": " + std::string(line, size)});
+            }
+        }
+        if(size > 0 || newline) {
+            part.result.lines++;
+        }
+
+        line = lineEnd + 1;
+    }
+}
+
+bool verifySentences(const std::string & path, const VerifyOptions & options, VerifyResult & result,
+                     std::ostream & log)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if(fd < 0 || fstat(fd, &status) != 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    size_t size = (size_t) status.st_size;
+    const char * data = nullptr;
+    if(size > 0) {
+        void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if(mapping == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        madvise(mapping, size, MADV_WILLNEED);
+        data = (const char *) mapping;
+    }
+    close(fd);
+
+    // a part per thread, each ending just after a newline.
+    int threads = std::max(options.threads, 1);
+    std::vector<VerifyPart> parts;
+    const char * at = data;
+    const char * end = data + size;
+    for(int t=0; t<threads && at < end; t++)
+    {
+        const char * partEnd = t == threads - 1 ? end : at + std::max((size_t)(end - at) / (threads - t), (size_t) 1);
+        if(partEnd < end) {
+            const char * newline = (const char *) std::memchr(partEnd, '\n', (size_t)(end - partEnd));
+            partEnd = newline ? newline + 1 : end;
+        }
+        parts.push_back(VerifyPart{at, partEnd, VerifyResult(), {}});
+        at = partEnd;
+    }
+
+    SlicedCRC crc(options.crcParameters);
+    std::vector<std::thread> workers;
+    for(VerifyPart & part : parts) {
+        workers.emplace_back(verifyPart, std::ref(part), std::cref(options), std::cref(crc));
+    }
+    for(std::thread & worker : workers) {
+        worker.join();
+    }
+    if(data) {
+        munmap((void *) data, size);
+    }
+
+    // totals, and the failures numbered by line of the file.
+    result = VerifyResult();
+    size_t reported = 0;
+    for(const VerifyPart & part : parts)
+    {
+        for(const auto & failure : part.failures) {
+            if(reported++ < options.maxReported) {
+                log << path << ":" << (result.lines + failure.first + 1) << ": " << failure.second << std::endl;
+            }
+        }
+        result.lines += part.result.lines;
+        result.valid += part.result.valid;
+        result.wrongHash += part.result.wrongHash;
+        result.wrongLength += part.result.wrongLength;
+        result.noValue += part.result.noValue;
+    }
+    result.bytes = size;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
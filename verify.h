@@ -0,0 +1,75 @@
+/**
+ * @file verify.h
+ *
+ * Checks a file of sentences found earlier (a sentence per line) still state their own CRC, eg: after a CRC
+ * library upgrade. The file is memory mapped and split between threads at line boundaries. Each line must
+ * contain its value as 8 hex digits (either case, standing alone), and if it states "a length of N", N must be
+ * the length of the line.
+ *
+ * CRCs are worked out 8 bytes at a time (slicing-by-8), with tables made from the runtime CRC parameters, so
+ * any CRC is verified at the same speed. Other hashes go through calculateHash().
+ */
+#ifndef CRC_SENTENCES_VERIFY_H
+#define CRC_SENTENCES_VERIFY_H
+
+#include "crc_parameters.h"
+#include "hash_targets.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * A CRC calculated 8 bytes per step.
+ */
+class SlicedCRC
+{
+public:
+    explicit SlicedCRC(const CRCParameters & parameters);
+
+    uint32_t calculate(const char * data, size_t size) const;
+
+private:
+    bool reflectInput;
+    bool reflectOutput;
+    uint32_t initialValue;
+    uint32_t finalXOR;
+    uint32_t tables[8][256];
+};
+
+/**
+ * What to verify against.
+ */
+struct VerifyOptions
+{
+    HashFunction hashFunction = HashFunction::CRC;
+    CRCParameters crcParameters;
+    int matchBits = 32;      // leading bits of the hash that must match the value stated
+    int threads = 1;
+    size_t maxReported = 20; // failing lines written out, the rest are only counted
+};
+
+/**
+ * Totals of a file.
+ */
+struct VerifyResult
+{
+    uint64_t lines = 0;        // including blank lines, which are not checked
+    uint64_t valid = 0;
+    uint64_t wrongHash = 0;    // the hash is not the value stated
+    uint64_t wrongLength = 0;  // the length stated is not the length of the line
+    uint64_t noValue = 0;      // no 8 hex digit value found
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+/**
+ * Verifies every line of a file, failing lines (up to maxReported) are written to log.
+ * @return false if the file could not be read.
+ */
+bool verifySentences(const std::string & path, const VerifyOptions & options, VerifyResult & result,
+                     std::ostream & log);
+
+#endif //CRC_SENTENCES_VERIFY_H